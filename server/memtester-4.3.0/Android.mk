@@ -29,7 +29,55 @@ LOCAL_MODULE_TAGS:=optional
 
 LOCAL_SRC_FILES:= \
 	memtester.c \
-	tests.c
+	tests.c \
+	engine.c \
+	simd.c \
+	cache.c \
+	alloc.c \
+	numa.c \
+	stats.c \
+	events.c \
+	session.c \
+	cancel.c \
+	failures.c \
+	progress.c \
+	budget.c \
+	checkpoint.c \
+	physmap.c \
+	badpages.c \
+	procs.c \
+	backend.c
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/
+
+include $(BUILD_EXECUTABLE)
+
+# Benchmark of the test kernels, see README.
+include $(CLEAR_VARS)
+
+LOCAL_LDLIBS += -lpthread
+
+LOCAL_MODULE:=memtester-bench
+
+LOCAL_MODULE_TAGS:=optional
+
+LOCAL_SRC_FILES:= \
+	memtester-bench.c \
+	tests.c \
+	engine.c \
+	simd.c \
+	cache.c \
+	alloc.c \
+	numa.c \
+	stats.c \
+	events.c \
+	session.c \
+	cancel.c \
+	failures.c \
+	budget.c \
+	physmap.c \
+	badpages.c \
+	backend.c
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/
 
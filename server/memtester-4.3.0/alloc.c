@@ -0,0 +1,578 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the allocation of the test region.  A multi-GB region
+ * on 4 KB pages costs a TLB miss on nearly every cache line the sequential
+ * tests touch, and takes long to lock, so alloc_huge() first tries explicit
+ * hugetlb pages (1 GB, then 2 MB) and then an anonymous mapping with
+ * transparent huge pages requested through madvise().  If none of these
+ * work, alloc_anon() maps and locks the largest part of the request that can
+ * be locked.  It starts from the bound of /proc/meminfo and RLIMIT_MEMLOCK,
+ * maps that once, and if it can not all be locked, binary-searches for the
+ * largest lockable prefix of the same mapping: what was locked stays
+ * locked, only the tail that failed is given back, and what is left over at
+ * the end is unmapped.
+ *
+ * Faulting in a multi-GB region is mostly the kernel zeroing pages, so
+ * alloc_populate() spreads it over a few threads, each faulting in (and
+ * locking) its own chunk.  For the same reason the locked region of a
+ * finished session is kept (alloc_keep()) and handed to the next session
+ * which fits in it (alloc_reuse()), instead of being unlocked and unmapped.
+ *
+ * With -p alloc_phys() maps a range of a device instead, by default
+ * /dev/mem, with the cache attribute of -C.  Opened with O_SYNC, /dev/mem
+ * maps RAM uncached on x86, and non-cacheable (write-combining) on ARM; a
+ * PCI BAR can be mapped write-combined through its sysfs resourceN_wc file.
+ * A regular file or "memfd" can stand in for the device, to try the -p
+ * path on any machine; the "physical addresses" are then file offsets.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "alloc.h"
+
+/* Older C libraries lack some of these; the values are the Linux ABI. */
+#ifndef MAP_HUGETLB
+  #define MAP_HUGETLB 0x40000
+#endif
+#ifndef MAP_HUGE_SHIFT
+  #define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+  #define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+  #define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MADV_HUGEPAGE
+  #define MADV_HUGEPAGE 14
+#endif
+#ifndef MAP_POPULATE
+  #define MAP_POPULATE 0
+#endif
+#ifndef MAP_LOCKED
+  #define MAP_LOCKED 0
+#endif
+
+#define SIZE_2MB ((size_t) 2 << 20)
+#define SIZE_1GB ((size_t) 1 << 30)
+
+/* Parse the -H argument: "auto", "off", or a comma-separated list of
+   "1G", "2M" and "thp".  Returns the HUGE_* mask, or -1 if invalid. */
+int alloc_parse_huge(const char *arg) {
+    char tmp[64], *word, *save;
+    int mask = 0;
+
+    if (!strcmp(arg, "auto")) return HUGE_AUTO;
+    if (!strcmp(arg, "off")) return 0;
+    if (strlen(arg) >= sizeof(tmp)) return -1;
+    strcpy(tmp, arg);
+    for (word = strtok_r(tmp, ",", &save); word;
+         word = strtok_r(NULL, ",", &save)) {
+        if (!strcasecmp(word, "1G")) {
+            mask |= HUGE_1GB;
+        } else if (!strcasecmp(word, "2M")) {
+            mask |= HUGE_2MB;
+        } else if (!strcasecmp(word, "thp")) {
+            mask |= HUGE_THP;
+        } else {
+            return -1;
+        }
+    }
+    return mask;
+}
+
+/* Parse the -C argument; returns a PHYS_* attribute, or -1 if invalid. */
+int alloc_parse_cache(const char *arg) {
+    if (!strcmp(arg, "uc")) return PHYS_UNCACHED;
+    if (!strcmp(arg, "wc")) return PHYS_WC;
+    if (!strcmp(arg, "cached")) return PHYS_CACHED;
+    return -1;
+}
+
+/* An anonymous memory file of len bytes; returns its fd, or -1. */
+int alloc_memfd(off_t len) {
+#ifdef SYS_memfd_create
+    int fd = (int) syscall(SYS_memfd_create, "memtester", 0);
+
+    if (fd >= 0 && ftruncate(fd, len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Open device for a mapping with the cache attribute cache; *how says
+   what the mapping will be. */
+static int open_phys(const char *device, off_t end, int cache,
+                     const char **how) {
+    char path[256];
+    struct stat st;
+    int fd;
+
+    if (!strcmp(device, PHYS_MEMFD)) {
+        *how = "cached, memfd";
+        return alloc_memfd(end);
+    }
+    if (!stat(device, &st) && S_ISREG(st.st_mode)) {
+        /* A stand-in for the device; grown to hold the range. */
+        *how = "cached, regular file";
+        fd = open(device, O_RDWR);
+        if (fd >= 0 && st.st_size < end && ftruncate(fd, end) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    if (cache == PHYS_CACHED) {
+        *how = "cached";
+        return open(device, O_RDWR);
+    }
+    if (cache == PHYS_WC &&
+        snprintf(path, sizeof(path), "%s_wc", device) < (int) sizeof(path) &&
+        (fd = open(path, O_RDWR)) >= 0) {
+        *how = "write-combined";
+        return fd;
+    }
+#if defined(__arm__) || defined(__aarch64__)
+    *how = cache == PHYS_WC ? "write-combined" : "uncached (non-cacheable)";
+#else
+    *how = cache == PHYS_WC ? "uncached, no write-combined mapping of it" :
+                              "uncached";
+#endif
+    return open(device, O_RDWR | O_SYNC);
+}
+
+/* Map bytes of device from base, as the test region.  Returns -1 with
+   errno set on failure; *how says how the range is mapped. */
+int alloc_phys(struct region *r, const char *device, off_t base, size_t bytes,
+               size_t pagesize, int cache, const char **how) {
+    void *p;
+    int fd, err;
+
+    fd = open_phys(device, base + (off_t) bytes, cache, how);
+    if (fd < 0) return -1;
+    p = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd,
+             base);
+    err = errno;
+    close(fd); /* the mapping keeps the device open */
+    if (p == MAP_FAILED) {
+        errno = err;
+        return -1;
+    }
+    r->map = r->aligned = p;
+    r->maplen = r->bufsize = bytes;
+    r->pagesize = pagesize;
+    r->kind = REGION_PHYS;
+    r->capacity = 0;
+    return 0;
+}
+
+static int map_hugetlb(struct region *r, size_t len, size_t pagesize,
+                       int sizeflag) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeflag,
+                   -1, 0);
+
+    if (p == MAP_FAILED) return -1;
+    r->map = r->aligned = p;
+    r->maplen = r->bufsize = len;
+    r->pagesize = pagesize;
+    r->kind = REGION_HUGETLB;
+    return 0;
+}
+
+/* Anonymous mapping aligned to 2 MB, so the kernel can back all of it with
+   transparent huge pages. */
+static int map_thp(struct region *r, size_t len) {
+    size_t maplen = len + SIZE_2MB;
+    char *p, *aligned;
+
+    p = (char *) mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == (char *) MAP_FAILED) return -1;
+    aligned = (char *) (((size_t) p + SIZE_2MB - 1) & ~(SIZE_2MB - 1));
+    if (madvise(aligned, len, MADV_HUGEPAGE) < 0) {
+        munmap(p, maplen);
+        return -1;
+    }
+    r->map = p;
+    r->maplen = maplen;
+    r->aligned = aligned;
+    r->bufsize = len;
+    r->pagesize = SIZE_2MB;
+    r->kind = REGION_THP;
+    return 0;
+}
+
+/* Try to get wantbytes (rounded down to the huge page size) backed by huge
+   pages, in order of preference among the allowed kinds.  Returns 0 and
+   fills in r on success, -1 if the caller should fall back to small pages.
+   1 GB pages are only used when they cover the request exactly; rounding
+   down to 2 MB loses at most one 2 MB page. */
+int alloc_huge(struct region *r, size_t wantbytes, int allowed) {
+    size_t len;
+
+    memset(r, 0, sizeof(*r));
+    if ((allowed & HUGE_1GB) && wantbytes >= SIZE_1GB &&
+        !(wantbytes % SIZE_1GB)) {
+        if (!map_hugetlb(r, wantbytes, SIZE_1GB, MAP_HUGE_1GB)) return 0;
+    }
+    len = wantbytes & ~(SIZE_2MB - 1);
+    if (!len) return -1;
+    if ((allowed & HUGE_2MB) && !map_hugetlb(r, len, SIZE_2MB, MAP_HUGE_2MB)) {
+        return 0;
+    }
+    if ((allowed & HUGE_THP) && !map_thp(r, len)) {
+        return 0;
+    }
+    return -1;
+}
+
+/* Memory the kernel could give us without swapping, from /proc/meminfo.
+   Kernels before 3.14 have no MemAvailable; estimate it from the free and
+   page cache pages.  Returns 0 if unknown. */
+static size_t meminfo_available(void) {
+    char line[128];
+    unsigned long long kb, avail = 0, free_kb = 0, cached = 0, buffers = 0;
+    int have_avail = 0;
+    FILE *f = fopen("/proc/meminfo", "r");
+
+    if (!f) return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+            avail = kb;
+            have_avail = 1;
+        } else if (sscanf(line, "MemFree: %llu kB", &kb) == 1) {
+            free_kb = kb;
+        } else if (sscanf(line, "Cached: %llu kB", &kb) == 1) {
+            cached = kb;
+        } else if (sscanf(line, "Buffers: %llu kB", &kb) == 1) {
+            buffers = kb;
+        }
+    }
+    fclose(f);
+    if (!have_avail) avail = free_kb + cached + buffers;
+    if (avail > ((size_t) -1 >> 10)) return (size_t) -1;  /* 32-bit */
+    return (size_t) (avail << 10);
+}
+
+/* Upper bound on how much memory can be locked: what is available, and
+   RLIMIT_MEMLOCK unless we run as root (CAP_IPC_LOCK ignores it).  *why
+   names the tighter bound. */
+size_t alloc_lock_limit(const char **why) {
+    struct rlimit rl;
+    size_t limit = (size_t) -1, avail;
+
+    *why = "none";
+    avail = meminfo_available();
+    if (avail) {
+        limit = avail;
+        *why = "MemAvailable";
+    }
+    if (geteuid() != 0 && !getrlimit(RLIMIT_MEMLOCK, &rl) &&
+        rl.rlim_cur != RLIM_INFINITY && (size_t) rl.rlim_cur < limit) {
+        limit = (size_t) rl.rlim_cur;
+        *why = "RLIMIT_MEMLOCK";
+    }
+    return limit;
+}
+
+/* One prefault thread's share of the region. */
+struct populate_chunk {
+    pthread_t thread;
+    char volatile *start;
+    size_t len;
+    int lock;
+    int joinable;                       /* thread was started */
+    int err;                            /* errno of a failed mlock() */
+};
+
+static void *populate_thread(void *arg) {
+    struct populate_chunk *c = (struct populate_chunk *) arg;
+    size_t stride = (size_t) sysconf(_SC_PAGE_SIZE), i;
+
+    /* mlock() faults the pages in itself. */
+    if (c->lock) {
+        c->err = mlock((void *) c->start, c->len) < 0 ? errno : 0;
+        return NULL;
+    }
+    for (i = 0; i < c->len; i += stride) {
+        c->start[i] = 0;
+    }
+    c->err = 0;
+    return NULL;
+}
+
+static int populate(void volatile *p, size_t len, size_t pagesize,
+                    int nthreads, int lock) {
+    struct populate_chunk chunks[ALLOC_MAX_THREADS];
+    size_t pages = len / pagesize, per, off = 0;
+    int i, err = 0;
+
+    if (nthreads > ALLOC_MAX_THREADS) nthreads = ALLOC_MAX_THREADS;
+    if ((size_t) nthreads > pages) nthreads = (int) pages;
+    if (nthreads < 1) nthreads = 1;
+    per = pages / nthreads;
+
+    for (i = 0; i < nthreads; i++) {
+        chunks[i].start = (char volatile *) p + off;
+        chunks[i].len = (i == nthreads - 1) ? len - off : per * pagesize;
+        chunks[i].lock = lock;
+        chunks[i].err = 0;
+        chunks[i].joinable = 0;
+        off += chunks[i].len;
+    }
+    /* The calling thread takes the last chunk, and any chunk it could not
+       start a thread for. */
+    for (i = 0; i < nthreads - 1; i++) {
+        chunks[i].joinable = !pthread_create(&chunks[i].thread, NULL,
+                                             populate_thread, &chunks[i]);
+        if (!chunks[i].joinable) populate_thread(&chunks[i]);
+    }
+    populate_thread(&chunks[nthreads - 1]);
+    for (i = 0; i < nthreads; i++) {
+        if (chunks[i].joinable) pthread_join(chunks[i].thread, NULL);
+        if (chunks[i].err && !err) err = chunks[i].err;
+    }
+    if (err) {
+        if (lock) munlock((void *) p, len);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* Fault in and lock [p, p + len) using up to nthreads threads on disjoint
+   chunks.  Chunk boundaries fall on pagesize, which must be the size of the
+   pages backing the region: the kernel cannot split a hugetlb mapping
+   anywhere else.  Returns 0, or -1 with errno set and nothing left locked. */
+int alloc_populate(void volatile *p, size_t len, size_t pagesize,
+                   int nthreads) {
+    return populate(p, len, pagesize, nthreads, 1);
+}
+
+/* Map len bytes of anonymous memory and let bind (if any) place it.  With
+   one thread and nothing to bind first, the kernel faults the mapping in
+   (and locks it) within mmap(); populate() then only confirms it, as
+   mmap() does not report a failure to fault in or lock.  With more
+   threads populate() does the faulting, spread over them. */
+static void *map_anon(size_t len, int lock, int nthreads, alloc_bind_fn bind,
+                      void *bind_arg) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS, err;
+    void *p;
+
+    if (nthreads <= 1 && !bind) {
+        flags |= MAP_POPULATE | (lock ? MAP_LOCKED : 0);
+    }
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    if (bind && bind(p, len, bind_arg) < 0) {
+        err = errno;
+        munmap(p, len);
+        errno = err;
+        return NULL;
+    }
+    return p;
+}
+
+/* Map (and lock, if lock) as much of wantbytes as possible.  The request,
+   cut down to alloc_lock_limit() if locking, is mapped once.  If it can not
+   all be faulted in or locked, a binary search on the same mapping finds
+   the largest prefix that can, to within 1/256 of the request: a prefix
+   that was locked is kept and only grown, the tail that failed is unlocked
+   and its pages given back before the next try, and what is beyond the
+   prefix at the end is unmapped.  Returns 0 on success, or -1 with errno
+   set (EPERM means locking is not allowed at all). */
+int alloc_anon(struct region *r, size_t wantbytes, size_t pagesize, int lock,
+               int nthreads, alloc_bind_fn bind, void *bind_arg) {
+    const char *why;
+    size_t len, lo = 0, bad, try, half, step, limit;
+    char *p;
+    int err;
+
+    memset(r, 0, sizeof(*r));
+    len = wantbytes;
+    if (lock) {
+        limit = alloc_lock_limit(&why);
+        if (len > limit) len = limit;
+    }
+    len &= ~(pagesize - 1);
+    step = (len >> 8) & ~(pagesize - 1);
+    if (step < pagesize) step = pagesize;
+
+    /* Address space is cheap to try for; memory is not. */
+    while (len && !(p = (char *) map_anon(len, lock, nthreads, bind,
+                                          bind_arg))) {
+        if (errno != ENOMEM && errno != EAGAIN) return -1;
+        len = len > step ? (len - len / 8) & ~(pagesize - 1) : 0;
+    }
+    if (!len) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* [0, lo) is faulted in (and locked); bad is a size known to fail. */
+    bad = len + pagesize;
+    try = len;
+    for (;;) {
+        if (!populate(p + lo, try - lo, pagesize, nthreads, lock)) {
+            lo = try;
+        } else if (errno == ENOMEM || errno == EAGAIN) {
+            /* populate() unlocked what it had locked of [lo, try);
+               MAP_LOCKED may have locked beyond it. */
+            if (lock) munlock(p + lo, len - lo);
+            madvise(p + lo, len - lo, MADV_DONTNEED);
+            bad = try;
+        } else {
+            err = errno;
+            munmap(p, len);
+            errno = err;
+            return -1;
+        }
+        if (bad - lo <= step) break;
+        half = ((bad - lo) / 2) & ~(pagesize - 1);
+        try = lo + (half > pagesize ? half : pagesize);
+    }
+    if (!lo) {
+        munmap(p, len);
+        errno = ENOMEM;
+        return -1;
+    }
+    if (lo < len) munmap(p + lo, len - lo);
+    r->map = r->aligned = p;
+    r->maplen = r->bufsize = lo;
+    r->pagesize = pagesize;
+    r->kind = REGION_ANON;
+    return 0;
+}
+
+void alloc_release(struct region *r) {
+    if (!r->map) return;
+    munmap((void *) r->map, r->maplen);
+    r->map = r->aligned = NULL;
+}
+
+/* The locked region of the last session, kept for the next one. */
+static struct region kept;
+static pthread_mutex_t kept_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Keep a locked region for the next session instead of unmapping it.  Only
+   one is kept, the larger; the other one is released. */
+void alloc_keep(struct region *r) {
+    struct region old;
+
+    if (r->capacity) r->bufsize = r->capacity;
+    r->capacity = 0;
+    pthread_mutex_lock(&kept_lock);
+    if (kept.map && kept.bufsize >= r->bufsize) {
+        old = *r;
+    } else {
+        old = kept;
+        kept = *r;
+    }
+    pthread_mutex_unlock(&kept_lock);
+    r->map = r->aligned = NULL;
+    alloc_release(&old);
+}
+
+static int kind_allowed(const struct region *r, int allowed) {
+    switch (r->kind) {
+        case REGION_HUGETLB:
+            return allowed & (r->pagesize == SIZE_1GB ? HUGE_1GB : HUGE_2MB);
+        case REGION_THP:
+            return allowed & HUGE_THP;
+        default:
+            return 1;
+    }
+}
+
+/* Take the kept region if it holds wantbytes and -H allows its pages.  The
+   first wantbytes (whole pages) are tested; the rest stays locked with it
+   and is kept again afterwards.  If it does not fit it is released, so the
+   new allocation can have its memory. */
+int alloc_reuse(struct region *r, size_t wantbytes, int allowed,
+                size_t pagesize) {
+    struct region old;
+    int ok;
+
+    pthread_mutex_lock(&kept_lock);
+    old = kept;
+    ok = kept.map && kept.bufsize >= wantbytes && kind_allowed(&kept, allowed);
+    kept.map = kept.aligned = NULL;
+    kept.bufsize = 0;
+    pthread_mutex_unlock(&kept_lock);
+    if (!ok) {
+        alloc_release(&old);
+        return -1;
+    }
+    *r = old;
+    r->capacity = r->bufsize;
+    r->bufsize = wantbytes & ~(pagesize - 1);
+    return 0;
+}
+
+/* Bytes of the kept region, 0 if there is none. */
+size_t alloc_kept(void) {
+    size_t len;
+
+    pthread_mutex_lock(&kept_lock);
+    len = kept.map ? kept.bufsize : 0;
+    pthread_mutex_unlock(&kept_lock);
+    return len;
+}
+
+void alloc_drop_kept(void) {
+    struct region old;
+
+    pthread_mutex_lock(&kept_lock);
+    old = kept;
+    kept.map = kept.aligned = NULL;
+    kept.bufsize = 0;
+    pthread_mutex_unlock(&kept_lock);
+    alloc_release(&old);
+}
+
+const char *alloc_kind_name(int kind) {
+    switch (kind) {
+        case REGION_HUGETLB:
+            return "hugetlb";
+        case REGION_THP:
+            return "transparent huge pages";
+        case REGION_PHYS:
+            return "physical";
+        case REGION_MEMFD:
+            return "memfd";
+        case REGION_FILE:
+            return "file";
+        default:
+            return "anonymous";
+    }
+}
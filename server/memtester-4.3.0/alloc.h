@@ -0,0 +1,79 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for allocating the test region.
+ * See alloc.c.
+ *
+ */
+
+#ifndef MEMTESTER_ALLOC_H
+#define MEMTESTER_ALLOC_H
+
+#include <sys/types.h>
+
+/* Which kinds of huge pages alloc_huge() may use (-H). */
+#define HUGE_1GB        0x01    /* explicit hugetlb, 1 GB pages */
+#define HUGE_2MB        0x02    /* explicit hugetlb, 2 MB pages */
+#define HUGE_THP        0x04    /* transparent huge pages via madvise */
+#define HUGE_AUTO       (HUGE_1GB | HUGE_2MB | HUGE_THP)
+
+/* Most threads alloc_populate() and alloc_anon() fault pages in with. */
+#define ALLOC_MAX_THREADS 64
+
+/* Cache attributes of a -p mapping (-C), see alloc_phys(). */
+#define PHYS_UNCACHED   0
+#define PHYS_WC         1               /* write-combined */
+#define PHYS_CACHED     2
+#define PHYS_MEMFD      "memfd"         /* -d for an anonymous memory file */
+
+/* How the test region was obtained. */
+#define REGION_ANON     0
+#define REGION_HUGETLB  1
+#define REGION_THP      2
+#define REGION_PHYS     3
+#define REGION_MEMFD    4
+#define REGION_FILE     5               /* hugetlbfs, tmpfs or other file */
+
+struct region {
+    void volatile *map;         /* what to munmap */
+    size_t maplen;
+    void volatile *aligned;     /* start of the tested memory */
+    size_t bufsize;             /* bytes tested, from aligned */
+    size_t pagesize;            /* size of the pages backing it */
+    int kind;                   /* REGION_* */
+    size_t capacity;            /* if reused, bytes locked from aligned */
+};
+
+/* Called on a fresh mapping before its pages are first touched, e.g. to
+   place it on NUMA nodes. */
+typedef int (*alloc_bind_fn)(void volatile *p, size_t len, void *arg);
+
+/* Function declarations. */
+
+int alloc_parse_huge(const char *arg);
+int alloc_huge(struct region *r, size_t wantbytes, int allowed);
+size_t alloc_lock_limit(const char **why);
+int alloc_anon(struct region *r, size_t wantbytes, size_t pagesize, int lock,
+               int nthreads, alloc_bind_fn bind, void *bind_arg);
+int alloc_populate(void volatile *p, size_t len, size_t pagesize,
+                   int nthreads);
+void alloc_release(struct region *r);
+void alloc_keep(struct region *r);
+int alloc_reuse(struct region *r, size_t wantbytes, int allowed,
+                size_t pagesize);
+size_t alloc_kept(void);
+void alloc_drop_kept(void);
+const char *alloc_kind_name(int kind);
+int alloc_parse_cache(const char *arg);
+int alloc_memfd(off_t len);
+int alloc_phys(struct region *r, const char *device, off_t base, size_t bytes,
+               size_t pagesize, int cache, const char **how);
+
+#endif /* MEMTESTER_ALLOC_H */
@@ -0,0 +1,227 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the memory backends of -B.  By default the session
+ * gets its region as alloc.c sees fit: a region kept from the last session,
+ * huge pages, or as much anonymous memory as can be locked.  A backend
+ * instead gets it one way only, so the kernels can be timed, and memory
+ * tested, the way an application has it:
+ *
+ *     anon        anonymous private mapping
+ *     memfd       shared mapping of an anonymous memory file
+ *     file:PATH   shared mapping of a file on hugetlbfs, tmpfs or any other
+ *                 file system, made if there is none and removed again; of
+ *                 an unnamed new one if PATH is a directory; of an existing
+ *                 one only with -W
+ *     mem         the -p range of /dev/mem (or of -d), as without -B
+ *
+ * Each one acquires the region, locks it, reads its physical addresses for
+ * the failure reports, and releases it.  Nothing else in the session
+ * depends on where the region came from.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "backend.h"
+#include "physmap.h"
+
+#ifndef HUGETLBFS_MAGIC
+  #define HUGETLBFS_MAGIC 0x958458f6
+#endif
+#ifndef TMPFS_MAGIC
+  #define TMPFS_MAGIC 0x01021994
+#endif
+
+#define DEV_MEM "/dev/mem"
+
+/* Map len bytes of fd (or anonymous memory if fd is -1) as r. */
+static int map_region(struct region *r, int fd, size_t len, size_t pagesize,
+                      int kind) {
+    void *p;
+
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+             fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    memset(r, 0, sizeof(*r));
+    r->map = r->aligned = p;
+    r->maplen = r->bufsize = len;
+    r->pagesize = pagesize;
+    r->kind = kind;
+    return 0;
+}
+
+static int acquire_anon(struct region *r, size_t bytes,
+                        const struct backend_args *a, const char **how) {
+    *how = "anonymous";
+    bytes &= ~(a->pagesize - 1);
+    if (!bytes) {
+        errno = EINVAL;
+        return -1;
+    }
+    return map_region(r, -1, bytes, a->pagesize, REGION_ANON);
+}
+
+static int acquire_memfd(struct region *r, size_t bytes,
+                         const struct backend_args *a, const char **how) {
+    int fd, ret, err;
+
+    *how = "memfd";
+    bytes &= ~(a->pagesize - 1);
+    if (!bytes) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = alloc_memfd((off_t) bytes);
+    if (fd < 0) return -1;
+    ret = map_region(r, fd, bytes, a->pagesize, REGION_MEMFD);
+    err = errno;
+    close(fd); /* the mapping keeps the file */
+    errno = err;
+    return ret;
+}
+
+/* A new file in dir which is gone once it is unmapped. */
+static int open_unnamed(const char *dir) {
+    char path[512];
+    int fd;
+
+    if (snprintf(path, sizeof(path), "%s/memtester.XXXXXX", dir) >=
+        (int) sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = mkstemp(path);
+    if (fd >= 0) unlink(path);
+    return fd;
+}
+
+static int acquire_file(struct region *r, size_t bytes,
+                        const struct backend_args *a, const char **how) {
+    struct statfs fs;
+    struct stat st;
+    size_t page = a->pagesize;
+    int fd, ret = -1, err, made = 0;
+
+    if (!stat(a->path, &st) && S_ISDIR(st.st_mode)) {
+        fd = open_unnamed(a->path);
+        made = 1;
+    } else if ((fd = open(a->path, O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0) {
+        /* Ours: the mapping keeps it until the region is released. */
+        unlink(a->path);
+        made = 1;
+    } else if (errno == EEXIST) {
+        fd = open(a->path, O_RDWR);
+    }
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0 || fstatfs(fd, &fs) < 0) goto out;
+    if ((unsigned long) fs.f_type == HUGETLBFS_MAGIC) {
+        /* Its files are made of huge pages of the block size. */
+        *how = "hugetlbfs file";
+        page = (size_t) fs.f_bsize;
+    } else if ((unsigned long) fs.f_type == TMPFS_MAGIC) {
+        *how = "tmpfs file";
+    } else {
+        *how = "file";
+    }
+    if (!made) {
+        /* Another program's file, such as a shared memory segment: it is
+           only written over when asked to, and tested as large as it is
+           if that is less, never resized. */
+        if (!a->overwrite) {
+            errno = EEXIST;
+            goto out;
+        }
+        if ((unsigned long long) st.st_size < bytes) {
+            bytes = (size_t) st.st_size;
+        }
+    }
+    bytes &= ~(page - 1);
+    if (!bytes) {
+        errno = EINVAL;
+        goto out;
+    }
+    if (made && ftruncate(fd, (off_t) bytes) < 0) goto out;
+    ret = map_region(r, fd, bytes, page, REGION_FILE);
+out:
+    err = errno;
+    close(fd); /* the mapping keeps the file */
+    errno = err;
+    return ret;
+}
+
+static int acquire_mem(struct region *r, size_t bytes,
+                       const struct backend_args *a, const char **how) {
+    memset(r, 0, sizeof(*r));
+    return alloc_phys(r, a->path ? a->path : DEV_MEM, a->base, bytes,
+                      a->pagesize, a->cache, how);
+}
+
+static int lock_populate(struct region *r, int nthreads) {
+    return alloc_populate(r->aligned, r->bufsize, r->pagesize, nthreads);
+}
+
+/* The mapping of a device is not faulted in page by page. */
+static int lock_mem(struct region *r, int nthreads) {
+    (void) nthreads;
+    return mlock((void *) r->aligned, r->bufsize);
+}
+
+static int translate_pagemap(struct region *r, struct physmap *m) {
+    return physmap_build(m, r->aligned, r->bufsize);
+}
+
+static const struct backend_ops backends[] = {
+    { "anon", 0, acquire_anon, lock_populate, translate_pagemap,
+      alloc_release },
+    { "memfd", 0, acquire_memfd, lock_populate, translate_pagemap,
+      alloc_release },
+    { "file", 0, acquire_file, lock_populate, translate_pagemap,
+      alloc_release },
+    { "mem", 1, acquire_mem, lock_mem, NULL, alloc_release },
+};
+
+#define NBACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+/* The backend of the -B argument, NAME or file:PATH; its path goes into
+   a.  Returns NULL if there is no such backend. */
+const struct backend_ops *backend_find(const char *arg,
+                                       struct backend_args *a) {
+    const char *colon = strchr(arg, ':');
+    size_t len = colon ? (size_t) (colon - arg) : strlen(arg);
+    size_t i;
+
+    for (i = 0; i < NBACKENDS; i++) {
+        if (strlen(backends[i].name) != len ||
+            strncmp(arg, backends[i].name, len)) {
+            continue;
+        }
+        /* Only "file" takes a path, and needs one. */
+        if ((backends[i].acquire == acquire_file) != (colon && colon[1])) {
+            return NULL;
+        }
+        if (colon) a->path = colon + 1;
+        return &backends[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,54 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the memory backends of -B, which
+ * say where the test region comes from.  See backend.c.
+ *
+ */
+
+#ifndef MEMTESTER_BACKEND_H
+#define MEMTESTER_BACKEND_H
+
+#include <sys/types.h>
+
+#include "alloc.h"
+
+struct physmap;
+
+/* What a backend is asked for besides the size. */
+struct backend_args {
+    const char *path;           /* "file": a file or directory; "mem": -d */
+    off_t base;                 /* "mem": -p */
+    int cache;                  /* "mem": -C */
+    int overwrite;              /* "file": -W, an existing file may be used */
+    size_t pagesize;            /* the system's */
+};
+
+struct backend_ops {
+    const char *name;
+    int physical;               /* maps the physical range of -p, needs it */
+    /* Map bytes as r, or all of an existing file that is smaller; *how
+       says what was mapped.  Returns -1 with errno set. */
+    int (*acquire)(struct region *r, size_t bytes,
+                   const struct backend_args *a, const char **how);
+    /* Fault r in and lock it, with up to nthreads threads. */
+    int (*lock)(struct region *r, int nthreads);
+    /* Read the physical addresses of r into m; NULL where the offsets
+       from -p are the physical addresses. */
+    int (*translate)(struct region *r, struct physmap *m);
+    void (*release)(struct region *r);
+};
+
+/* Function declarations. */
+
+const struct backend_ops *backend_find(const char *arg,
+                                       struct backend_args *a);
+
+#endif /* MEMTESTER_BACKEND_H */
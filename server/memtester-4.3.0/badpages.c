@@ -0,0 +1,257 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the bad-page quarantine of -b.  A page with a failing
+ * word is marked bad, and the tests after that are run on the rest of the
+ * region only: the worker's slice is cut into the runs of words which are
+ * not on a bad page, in bufa nor in bufb (the tests compare the two word by
+ * word), and the test is run on each run in turn.  A weak page is then
+ * reported by the tests that find it and no longer fails every test after
+ * them, and the rest of the region is still tested at full speed.
+ *
+ * The set is kept in a file as physical page addresses, one per line:
+ *
+ *     memtester bad pages 1
+ *     0x0000000149aaa000
+ *
+ * so the next session leaves the same pages out.  Pages of the file which
+ * are not in the region are kept in it.  A page whose physical address is
+ * not known (no -p, and no pagemap) is quarantined for the session only.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "badpages.h"
+#include "physmap.h"
+
+#define BADPAGES_VERSION 1
+#define WORD sizeof(unsigned long)
+
+int badpages_init(struct badpages *b, size_t bytes, size_t page) {
+    memset(b, 0, sizeof(*b));
+    b->page = page;
+    b->npages = (bytes + page - 1) / page;
+    b->bad = (unsigned char *) calloc(b->npages, 1);
+    return b->bad ? 0 : -1;
+}
+
+void badpages_free(struct badpages *b) {
+    free(b->bad);
+    free(b->phys);
+    memset(b, 0, sizeof(*b));
+}
+
+/* Add the physical page to the sorted list, once. */
+static int add_phys(struct badpages *b, unsigned long long phys) {
+    unsigned long long *p;
+    int lo = 0, hi = b->nphys;
+
+    while (lo < hi) {
+        if (b->phys[(lo + hi) / 2] < phys) {
+            lo = (lo + hi) / 2 + 1;
+        } else {
+            hi = (lo + hi) / 2;
+        }
+    }
+    if (lo < b->nphys && b->phys[lo] == phys) return 0;
+    if (b->nphys == b->size) {
+        p = (unsigned long long *) realloc(b->phys, (b->size ? b->size * 2 :
+                                           64) * sizeof(*p));
+        if (!p) return -1;
+        b->phys = p;
+        b->size = b->size ? b->size * 2 : 64;
+    }
+    memmove(b->phys + lo + 1, b->phys + lo,
+            (b->nphys - lo) * sizeof(*b->phys));
+    b->phys[lo] = phys;
+    b->nphys++;
+    return 1;
+}
+
+/* Read the bad pages of an earlier session from path; returns -1 with
+   errno set, ENOENT if there is no file yet. */
+int badpages_load(struct badpages *b, const char *path) {
+    char line[128], *end;
+    unsigned long long phys;
+    int version = 0;
+    FILE *f;
+
+    if (!(f = fopen(path, "r"))) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "memtester bad pages %d", &version) == 1 ||
+            line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        errno = 0;
+        phys = strtoull(line, &end, 0);
+        if (errno || end == line || version != BADPAGES_VERSION ||
+            add_phys(b, phys & ~((unsigned long long) b->page - 1)) < 0) {
+            fclose(f);
+            errno = errno == ENOMEM ? ENOMEM : EINVAL;
+            return -1;
+        }
+    }
+    fclose(f);
+    if (version != BADPAGES_VERSION) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Quarantine the pages of the list which are in the region, with -p from
+   base, else through map (NULL if there is none); returns how many were
+   not quarantined already. */
+int badpages_place(struct badpages *b, int use_phys,
+                   unsigned long long base, const struct physmap *map) {
+    unsigned long long phys;
+    size_t offset;
+    int i, n = 0;
+
+    for (i = 0; i < b->nphys; i++) {
+        phys = b->phys[i];
+        if (use_phys) {
+            if (phys < base || phys - base >= (unsigned long long) b->npages *
+                b->page) {
+                continue;
+            }
+            offset = (size_t) (phys - base);
+        } else if (!map || physmap_offset(map, phys, &offset) < 0) {
+            continue;
+        }
+        n += badpages_add(b, offset);
+    }
+    return n;
+}
+
+/* The word at offset into the region failed; called from the workers.
+   Returns 1 if its page is newly quarantined. */
+int badpages_add(struct badpages *b, size_t offset) {
+    size_t page = offset / b->page;
+
+    if (page >= b->npages || b->bad[page]) return 0;
+    /* Take a slot first, so workers failing at once cannot go over. */
+    if (__atomic_fetch_add(&b->count, 1, __ATOMIC_RELAXED) >= BADPAGES_MAX) {
+        __atomic_sub_fetch(&b->count, 1, __ATOMIC_RELAXED);
+        b->full = 1;
+        return 0;
+    }
+    if (__atomic_exchange_n(&b->bad[page], 1, __ATOMIC_RELAXED)) {
+        /* Another worker quarantined it meanwhile. */
+        __atomic_sub_fetch(&b->count, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return 1;
+}
+
+/* Where the page of word i of the buffer at offa ends, or count. */
+static size_t page_end(const struct badpages *b, size_t offa, size_t i,
+                       size_t count) {
+    size_t j = i + (b->page - (offa + i * WORD) % b->page) / WORD;
+
+    return j < count ? j : count;
+}
+
+/* Whether words [i, j), all on one page of the buffer at offa, are on a
+   quarantined page there or in the buffer at offb. */
+static int touches(const struct badpages *b, size_t offa, size_t offb,
+                   size_t i, size_t j) {
+    if (b->bad[(offa + i * WORD) / b->page]) return 1;
+    if (offb == BADPAGES_NONE) return 0;
+    return b->bad[(offb + i * WORD) / b->page] ||
+           b->bad[(offb + j * WORD - 1) / b->page];
+}
+
+/* The next run [*start, *end) of the count words of the buffers at region
+   offsets offa and offb (BADPAGES_NONE for one buffer) that is on no
+   quarantined page, from *end on; returns 0 when there is none.  Runs
+   start and end on page boundaries of the first buffer. */
+int badpages_next(const struct badpages *b, size_t offa, size_t offb,
+                  size_t count, size_t *start, size_t *end) {
+    size_t i = *end, j;
+
+    for (; i < count; i = j) {
+        j = page_end(b, offa, i, count);
+        if (!touches(b, offa, offb, i, j)) break;
+    }
+    if (i >= count) return 0;
+    *start = i;
+    for (; i < count; i = j) {
+        j = page_end(b, offa, i, count);
+        if (touches(b, offa, offb, i, j)) break;
+    }
+    *end = i;
+    return 1;
+}
+
+/* Bytes the tests leave out of count words at the start of the region
+   and, unless offb is BADPAGES_NONE, as many at offb. */
+unsigned long long badpages_excluded(const struct badpages *b, size_t offb,
+                                     size_t count) {
+    unsigned long long words = 0;
+    size_t i, j;
+
+    for (i = 0; i < count; i = j) {
+        j = page_end(b, 0, i, count);
+        if (touches(b, 0, offb, i, j)) words += j - i;
+    }
+    return words * WORD * (offb == BADPAGES_NONE ? 1 : 2);
+}
+
+/* Add the quarantined pages to the list and replace the file at path with
+   it; returns -1 with errno set on failure. */
+int badpages_save(struct badpages *b, const char *path, int use_phys,
+                  unsigned long long base, const struct physmap *map) {
+    char tmp[512];
+    unsigned long long phys;
+    size_t page;
+    int i, err;
+    FILE *f;
+
+    b->saved = b->count;
+    for (page = 0; page < b->npages; page++) {
+        if (!b->bad[page]) continue;
+        if (use_phys) {
+            phys = base + (unsigned long long) page * b->page;
+        } else if (!map || physmap_lookup(map, page * b->page, &phys) < 0) {
+            continue;
+        }
+        if (add_phys(b, phys) < 0) return -1;
+    }
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (!(f = fopen(tmp, "w"))) return -1;
+    fprintf(f, "memtester bad pages %d\n", BADPAGES_VERSION);
+    for (i = 0; i < b->nphys; i++) {
+        fprintf(f, "0x%016llx\n", b->phys[i]);
+    }
+    if (fflush(f) || fsync(fileno(f)) < 0) {
+        err = errno;
+        fclose(f);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if (fclose(f) || rename(tmp, path) < 0) {
+        err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
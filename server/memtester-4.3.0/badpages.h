@@ -0,0 +1,53 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the bad-page quarantine of -b,
+ * which keeps failing pages out of the tests that follow.  See badpages.c.
+ *
+ */
+
+#ifndef MEMTESTER_BADPAGES_H
+#define MEMTESTER_BADPAGES_H
+
+#include <sys/types.h>
+
+#define BADPAGES_MAX        4096        /* pages quarantined at most */
+#define BADPAGES_NONE       ((size_t) -1)   /* no second buffer */
+
+struct physmap;
+
+struct badpages {
+    size_t page;                        /* bytes per page */
+    size_t npages;                      /* pages of the region */
+    unsigned char *bad;                 /* per page: quarantined */
+    int volatile count;                 /* pages quarantined */
+    int volatile full;                  /* a failing page was not taken */
+    int saved;                          /* count when last written */
+    unsigned long long *phys;           /* physical pages, sorted */
+    int nphys;
+    int size;                           /* phys allocated */
+};
+
+/* Function declarations. */
+
+int badpages_init(struct badpages *b, size_t bytes, size_t page);
+void badpages_free(struct badpages *b);
+int badpages_load(struct badpages *b, const char *path);
+int badpages_place(struct badpages *b, int use_phys,
+                   unsigned long long base, const struct physmap *map);
+int badpages_add(struct badpages *b, size_t offset);
+int badpages_next(const struct badpages *b, size_t offa, size_t offb,
+                  size_t count, size_t *start, size_t *end);
+unsigned long long badpages_excluded(const struct badpages *b, size_t offb,
+                                     size_t count);
+int badpages_save(struct badpages *b, const char *path, int use_phys,
+                  unsigned long long base, const struct physmap *map);
+
+#endif /* MEMTESTER_BADPAGES_H */
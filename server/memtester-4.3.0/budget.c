@@ -0,0 +1,139 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the time budget of -T.  A test is only started if it
+ * is expected to end before the deadline, so the session never has to cut
+ * one off half way.  What a test costs is taken from its last complete run;
+ * a test which has not run yet is estimated from the time per pattern of
+ * all runs so far (every pattern is written over the whole region and read
+ * back, so their cost is roughly the same).  Tests that do not fit are
+ * skipped and the shorter ones after them still run; once none fits the
+ * session ends.
+ *
+ * Coverage is counted in patterns verified over the region: a complete run
+ * of a test adds its patterns times the bytes tested.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+
+#include "budget.h"
+#include "timing.h"
+
+/* A duration: seconds, or a number with an s, m or h suffix. */
+int budget_parse(const char *arg, unsigned long long *ns) {
+    unsigned long long n, unit;
+    char *suffix;
+
+    errno = 0;
+    n = strtoull(arg, &suffix, 10);
+    if (errno || suffix == arg || !n) return -1;
+    switch (*suffix) {
+        case '\0':
+        case 's':
+            unit = 1;
+            break;
+        case 'm':
+            unit = 60;
+            break;
+        case 'h':
+            unit = 3600;
+            break;
+        default:
+            return -1;
+    }
+    if (*suffix && suffix[1]) return -1;
+    /* More nanoseconds than fit is no duration either. */
+    if (n > ULLONG_MAX / (unit * 1000000000ULL)) return -1;
+    *ns = n * unit * 1000000000ULL;
+    return 0;
+}
+
+/* The budget runs from start_ns; ntests counts the stuck address test too. */
+int budget_init(struct budget *b, unsigned long long start_ns,
+                unsigned long long ns, size_t bytes, int ntests) {
+    memset(b, 0, sizeof(*b));
+    b->tests = (struct budget_test *) calloc(ntests, sizeof(*b->tests));
+    if (!b->tests) return -1;
+    b->ntests = ntests;
+    b->ns = ns;
+    b->bytes = bytes;
+    b->start_ns = start_ns;
+    b->deadline_ns = ns > ULLONG_MAX - start_ns ? ULLONG_MAX : start_ns + ns;
+    return 0;
+}
+
+void budget_free(struct budget *b) {
+    free(b->tests);
+    b->tests = NULL;
+}
+
+/* Describe test i; patterns is 0 for a test that is not run. */
+void budget_test(struct budget *b, int i, const char *name,
+                 unsigned int patterns) {
+    b->tests[i].name = name;
+    b->tests[i].patterns = patterns;
+}
+
+unsigned long long budget_left(const struct budget *b) {
+    unsigned long long now = now_ns();
+
+    return now < b->deadline_ns ? b->deadline_ns - now : 0;
+}
+
+/* How long test i is expected to take; 0 if there is nothing to go by. */
+unsigned long long budget_estimate(const struct budget *b, int i) {
+    const struct budget_test *t = &b->tests[i];
+
+    if (t->last_ns) return t->last_ns;
+    if (!b->run_patterns) return 0;
+    return (unsigned long long) ((double) b->run_ns * t->patterns /
+                                 b->run_patterns);
+}
+
+/* Whether test i can still run before the deadline. */
+int budget_fits(const struct budget *b, int i) {
+    unsigned long long left = budget_left(b);
+
+    return b->tests[i].patterns && left && budget_estimate(b, i) <= left;
+}
+
+int budget_any_fits(const struct budget *b) {
+    int i;
+
+    for (i = 0; i < b->ntests; i++) {
+        if (budget_fits(b, i)) return 1;
+    }
+    return 0;
+}
+
+/* Test i ran to the end in ns. */
+void budget_done(struct budget *b, int i, unsigned long long ns) {
+    struct budget_test *t = &b->tests[i];
+
+    t->last_ns = ns ? ns : 1;
+    t->runs++;
+    b->run_ns += ns;
+    b->run_patterns += t->patterns;
+}
+
+void budget_skip(struct budget *b) {
+    b->skipped++;
+}
+
+/* Bytes times patterns verified by test i. */
+unsigned long long budget_coverage(const struct budget *b, int i) {
+    return (unsigned long long) b->tests[i].runs * b->tests[i].patterns *
+           b->bytes;
+}
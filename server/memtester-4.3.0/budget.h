@@ -0,0 +1,57 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the time budget of -T, which
+ * picks the tests that still fit before the deadline.  See budget.c.
+ *
+ */
+
+#ifndef MEMTESTER_BUDGET_H
+#define MEMTESTER_BUDGET_H
+
+#include <sys/types.h>
+
+/* One test of the loop: what a run of it costs and how often it ran. */
+struct budget_test {
+    const char *name;
+    unsigned int patterns;              /* per run; 0 if masked out */
+    unsigned long long last_ns;         /* its last complete run, 0 if none */
+    unsigned long runs;                 /* complete runs */
+};
+
+struct budget {
+    unsigned long long ns;              /* the budget */
+    unsigned long long start_ns;
+    unsigned long long deadline_ns;
+    size_t bytes;                       /* tested by each pattern */
+    unsigned long long run_ns;          /* all complete runs together ... */
+    unsigned long long run_patterns;    /* ... and their patterns */
+    unsigned long skipped;              /* runs left out for lack of time */
+    int ntests;
+    struct budget_test *tests;          /* [0] is the stuck address test */
+};
+
+/* Function declarations. */
+
+int budget_parse(const char *arg, unsigned long long *ns);
+int budget_init(struct budget *b, unsigned long long start_ns,
+                unsigned long long ns, size_t bytes, int ntests);
+void budget_free(struct budget *b);
+void budget_test(struct budget *b, int i, const char *name,
+                 unsigned int patterns);
+unsigned long long budget_left(const struct budget *b);
+unsigned long long budget_estimate(const struct budget *b, int i);
+int budget_fits(const struct budget *b, int i);
+int budget_any_fits(const struct budget *b);
+void budget_done(struct budget *b, int i, unsigned long long ns);
+void budget_skip(struct budget *b);
+unsigned long long budget_coverage(const struct budget *b, int i);
+
+#endif /* MEMTESTER_BUDGET_H */
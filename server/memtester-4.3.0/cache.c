@@ -0,0 +1,248 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the cache eviction used between the write and verify
+ * phases of the tests (-f).  Without it, a buffer that was just written can
+ * partly be read back from the cache, which hides DRAM faults.
+ *
+ * Where user space may flush cache lines (CLFLUSHOPT or CLFLUSH on x86,
+ * DC CIVAC on ARM64) the written range itself is flushed.  Elsewhere the
+ * caches are evicted by reading through a sweep buffer sized from the
+ * last-level cache reported in sysfs.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cache.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define CACHE_X86 1
+  #include <immintrin.h>
+  #include <cpuid.h>
+#endif
+
+#define DEFAULT_LLC_SIZE (8 << 20)
+
+enum evict_method {
+    EVICT_NONE,
+    EVICT_SWEEP,
+    EVICT_CLFLUSH,
+    EVICT_CLFLUSHOPT,
+    EVICT_DC_CIVAC
+};
+
+static const char *method_names[] = {
+    "none", "sweep", "clflush", "clflushopt", "dc civac"
+};
+
+static enum evict_method method = EVICT_NONE;
+static size_t line_size = 64;
+static size_t llc_size = DEFAULT_LLC_SIZE;
+static unsigned char volatile *sweep_buf;
+static size_t sweep_len;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+/* Parse a sysfs cache size such as "32K" or "8192K". */
+static size_t parse_size(const char *s) {
+    char *end;
+    size_t n = (size_t) strtoul(s, &end, 10);
+
+    switch (*end) {
+        case 'K':
+        case 'k':
+            return n << 10;
+        case 'M':
+        case 'm':
+            return n << 20;
+        default:
+            return n;
+    }
+}
+
+/* Size of the data or unified cache of cpu0 at level, or with level 0 of
+   the highest one; 0 if sysfs does not say. */
+static size_t read_cache_size(int want) {
+    char path[128], buf[32];
+    FILE *f;
+    int idx, level, best_level = 0;
+    size_t size, best = 0;
+
+    for (idx = 0; idx < 16; idx++) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+        if (!(f = fopen(path, "r"))) break;
+        buf[0] = '\0';
+        if (!fgets(buf, sizeof(buf), f)) buf[0] = '\0';
+        fclose(f);
+        if (!strncmp(buf, "Instruction", 11)) continue;
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+        if (!(f = fopen(path, "r"))) continue;
+        level = fscanf(f, "%d", &level) == 1 ? level : 0;
+        fclose(f);
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+        if (!(f = fopen(path, "r"))) continue;
+        size = fgets(buf, sizeof(buf), f) ? parse_size(buf) : 0;
+        fclose(f);
+
+        if (want && level != want) continue;
+        if (level > best_level || (level == best_level && size > best)) {
+            best_level = level;
+            best = size;
+        }
+    }
+    return best;
+}
+
+#ifdef CACHE_X86
+
+__attribute__((target("clflushopt")))
+static void flush_clflushopt(const char *p, const char *end) {
+    for (; p < end; p += line_size) {
+        _mm_clflushopt((void *) p);
+    }
+    _mm_mfence();
+}
+
+__attribute__((target("sse2")))
+static void flush_clflush(const char *p, const char *end) {
+    for (; p < end; p += line_size) {
+        _mm_clflush(p);
+    }
+    _mm_mfence();
+}
+
+static enum evict_method probe_method(void) {
+    unsigned int a, b, c, d;
+
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(d & (1u << 19))) {
+        return EVICT_SWEEP;                 /* no CLFLUSH */
+    }
+    if ((b >> 8) & 0xff) line_size = ((b >> 8) & 0xff) * 8;
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 23))) {
+        return EVICT_CLFLUSHOPT;
+    }
+    return EVICT_CLFLUSH;
+}
+
+#elif defined(__aarch64__)
+
+static void flush_dc_civac(const char *p, const char *end) {
+    for (; p < end; p += line_size) {
+        __asm__ volatile("dc civac, %0" : : "r" (p) : "memory");
+    }
+    __asm__ volatile("dsb ish" : : : "memory");
+}
+
+static enum evict_method probe_method(void) {
+    unsigned long ctr;
+
+    /* CTR_EL0.DminLine is log2 of the smallest D-cache line in words. */
+    __asm__ volatile("mrs %0, ctr_el0" : "=r" (ctr));
+    line_size = 4UL << ((ctr >> 16) & 0xf);
+    return EVICT_DC_CIVAC;
+}
+
+#else
+
+static enum evict_method probe_method(void) {
+    line_size = 32;                         /* smallest common line size */
+    return EVICT_SWEEP;
+}
+
+#endif
+
+static void cache_select(void) {
+    llc_size = read_cache_size(0);
+    if (!llc_size) llc_size = DEFAULT_LLC_SIZE;
+    method = probe_method();
+    if (method == EVICT_SWEEP) {
+        /* Twice the LLC is enough to push out everything under LRU-like
+           replacement. */
+        sweep_len = 2 * llc_size;
+        sweep_buf = (unsigned char volatile *) malloc(sweep_len);
+        if (!sweep_buf) {
+            method = EVICT_NONE;
+            return;
+        }
+        memset((void *) sweep_buf, 0, sweep_len);
+    }
+}
+
+void cache_init(void) {
+    pthread_once(&cache_once, cache_select);
+}
+
+const char *cache_evict_method(void) {
+    return method_names[method];
+}
+
+size_t cache_llc_size(void) {
+    return llc_size;
+}
+
+/* Size of cpu0's level 1, 2, ... data cache, 0 if unknown. */
+size_t cache_size(int level) {
+    return level > 0 ? read_cache_size(level) : 0;
+}
+
+static void flush_range(const void volatile *p, size_t len) {
+    const char *start = (const char *) ((size_t) p & ~(line_size - 1));
+    const char *end = (const char *) p + len;
+
+    switch (method) {
+#ifdef CACHE_X86
+        case EVICT_CLFLUSHOPT:
+            flush_clflushopt(start, end);
+            break;
+        case EVICT_CLFLUSH:
+            flush_clflush(start, end);
+            break;
+#endif
+#ifdef __aarch64__
+        case EVICT_DC_CIVAC:
+            flush_dc_civac(start, end);
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+/* Make sure the next reads of [a, a + len) and, if b is not NULL, of
+   [b, b + len) come from memory rather than from the cache. */
+void cache_evict(const void volatile *a, const void volatile *b, size_t len) {
+    unsigned long sum = 0;
+    size_t i;
+
+    switch (method) {
+        case EVICT_NONE:
+            break;
+        case EVICT_SWEEP:
+            /* One sweep evicts both ranges. */
+            for (i = 0; i < sweep_len; i += line_size) {
+                sum += sweep_buf[i];
+            }
+            (void) sum;
+            break;
+        default:
+            flush_range(a, len);
+            if (b) flush_range(b, len);
+            break;
+    }
+}
@@ -0,0 +1,29 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for evicting tested memory from the
+ * CPU caches.  See cache.c.
+ *
+ */
+
+#ifndef MEMTESTER_CACHE_H
+#define MEMTESTER_CACHE_H
+
+#include <sys/types.h>
+
+/* Function declarations. */
+
+void cache_init(void);
+const char *cache_evict_method(void);
+size_t cache_llc_size(void);
+size_t cache_size(int level);
+void cache_evict(const void volatile *a, const void volatile *b, size_t len);
+
+#endif /* MEMTESTER_CACHE_H */
@@ -0,0 +1,61 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the cancellation token of a session.  The session
+ * manager sets it when the client says stop, pause or resume; the test
+ * kernels and the session's loop poll it with cancel_point() every chunk
+ * of a megabyte or so, which keeps the reaction time to about a
+ * millisecond without a system call on the fast path.  A paused thread
+ * sleeps on the condition variable until it is resumed or stopped.
+ *
+ */
+
+#include <pthread.h>
+
+#include "cancel.h"
+
+static const char *state_names[] = { "running", "paused", "stopping" };
+
+void cancel_init(struct cancel_token *t) {
+    t->state = CANCEL_RUN;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->changed, NULL);
+}
+
+void cancel_destroy(struct cancel_token *t) {
+    pthread_cond_destroy(&t->changed);
+    pthread_mutex_destroy(&t->lock);
+}
+
+void cancel_set(struct cancel_token *t, int state) {
+    pthread_mutex_lock(&t->lock);
+    if (t->state != CANCEL_STOP) {
+        t->state = state;
+        pthread_cond_broadcast(&t->changed);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+/* The slow path of cancel_point(). */
+int cancel_wait(struct cancel_token *t) {
+    int stopped;
+
+    pthread_mutex_lock(&t->lock);
+    while (t->state == CANCEL_PAUSE) {
+        pthread_cond_wait(&t->changed, &t->lock);
+    }
+    stopped = t->state == CANCEL_STOP;
+    pthread_mutex_unlock(&t->lock);
+    return stopped;
+}
+
+const char *cancel_state_name(int state) {
+    return state_names[state];
+}
@@ -0,0 +1,46 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the token a session's client
+ * stops, pauses and resumes it with.  See cancel.c.
+ *
+ */
+
+#ifndef MEMTESTER_CANCEL_H
+#define MEMTESTER_CANCEL_H
+
+#include <pthread.h>
+
+/* States of a token. */
+#define CANCEL_RUN      0
+#define CANCEL_PAUSE    1
+#define CANCEL_STOP     2               /* final; pause and resume are ignored */
+
+struct cancel_token {
+    int volatile state;                 /* CANCEL_* */
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/* Function declarations. */
+
+void cancel_init(struct cancel_token *t);
+void cancel_destroy(struct cancel_token *t);
+void cancel_set(struct cancel_token *t, int state);
+int cancel_wait(struct cancel_token *t);
+const char *cancel_state_name(int state);
+
+/* Called between chunks of work: waits while paused and returns nonzero
+   once stopped.  While running it is one load and a branch. */
+static inline int cancel_point(struct cancel_token *t) {
+    return t->state != CANCEL_RUN && cancel_wait(t);
+}
+
+#endif /* MEMTESTER_CANCEL_H */
@@ -0,0 +1,168 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the checkpoint file of -c.  After every test the
+ * session writes where it is (loop, next test, seed, exit code so far) and
+ * the per-test totals of its summary to a small text file:
+ *
+ *     memtester checkpoint 1
+ *     cmd -c /data/mt.ckpt 512M
+ *     seed 0x...
+ *     loop 12
+ *     test 5
+ *     exit_code 0
+ *     stats <index> <runs> <failures> <ns> <bytes> <phase ns...>
+ *           <phase bytes...> <min GB/s> <max GB/s>
+ *
+ * (one stats line per test that has run).  The file is written to a
+ * temporary name and renamed over the old one, so a crash leaves either
+ * the old or the new checkpoint.  A session started with the same command
+ * reads it and goes on with the next test; the test data only depends on
+ * the seed, loop and test, so it writes what the old session would have.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+#define CHECKPOINT_VERSION 1
+
+/* The commands without a trailing newline, as clients may send one. */
+static int same_cmd(const char *a, const char *b) {
+    size_t la = strcspn(a, "\n"), lb = strcspn(b, "\n");
+
+    return la == lb && !strncmp(a, b, la);
+}
+
+/* Read the checkpoint at path into c and stats[0..n-1]; returns -1 with
+   errno set if there is none (ENOENT), it is unreadable (EINVAL) or it was
+   written for another command (ESRCH).  Nothing is changed then: the file
+   is parsed into copies, which replace c and stats once all of it is
+   read. */
+int checkpoint_load(const char *path, const char *cmd, struct checkpoint *c,
+                    struct test_stats *stats, int n) {
+    char line[512], *q;
+    struct checkpoint cp;
+    struct test_stats t, *loaded;
+    int version = 0, have_cmd = 0, k, p, used, err = EINVAL;
+    FILE *f;
+
+    if (!(f = fopen(path, "r"))) return -1;
+    if (!(loaded = (struct test_stats *) malloc(n * sizeof(*loaded)))) {
+        fclose(f);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(loaded, stats, n * sizeof(*loaded));
+    memset(&cp, 0, sizeof(cp));
+    cp.loop = 1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "memtester checkpoint %d", &version) == 1) {
+            continue;
+        } else if (!strncmp(line, "cmd ", 4)) {
+            if (!same_cmd(line + 4, cmd)) {
+                err = ESRCH;
+                version = 0;
+                break;
+            }
+            have_cmd = 1;
+        } else if (sscanf(line, "seed %llx", &cp.seed) == 1 ||
+                   sscanf(line, "loop %lu", &cp.loop) == 1 ||
+                   sscanf(line, "test %d", &cp.test) == 1 ||
+                   sscanf(line, "exit_code %d", &cp.exit_code) == 1) {
+            continue;
+        } else if (sscanf(line, "stats %d %lu %lu %llu %llu%n", &k, &t.runs,
+                          &t.failures, &t.total.ns, &t.total.bytes,
+                          &used) == 5 && k >= 0 && k < n) {
+            q = line + used;
+            for (p = 0; p < PHASES; p++) {
+                t.total.phase_ns[p] = strtoull(q, &q, 10);
+            }
+            for (p = 0; p < PHASES; p++) {
+                t.total.phase_bytes[p] = strtoull(q, &q, 10);
+            }
+            if (sscanf(q, "%lf %lf", &t.min_gbps, &t.max_gbps) != 2) {
+                version = 0;
+                break;
+            }
+            t.name = stats[k].name;
+            loaded[k] = t;
+        }
+    }
+    fclose(f);
+    if (version != CHECKPOINT_VERSION || !have_cmd || !cp.loop) {
+        free(loaded);
+        errno = err;
+        return -1;
+    }
+    *c = cp;
+    memcpy(stats, loaded, n * sizeof(*loaded));
+    free(loaded);
+    return 0;
+}
+
+/* Replace the checkpoint at path; returns -1 with errno set on failure. */
+int checkpoint_save(const char *path, const char *cmd,
+                    const struct checkpoint *c,
+                    const struct test_stats *stats, int n) {
+    char tmp[512];
+    const struct test_stats *t;
+    int k, p, err;
+    FILE *f;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (!(f = fopen(tmp, "w"))) return -1;
+    fprintf(f, "memtester checkpoint %d\n", CHECKPOINT_VERSION);
+    fprintf(f, "cmd %.*s\n", (int) strcspn(cmd, "\n"), cmd);
+    fprintf(f, "seed 0x%016llx\nloop %lu\ntest %d\nexit_code %d\n", c->seed,
+            c->loop, c->test, c->exit_code);
+    for (k = 0; k < n; k++) {
+        t = &stats[k];
+        if (!t->runs) continue;
+        fprintf(f, "stats %d %lu %lu %llu %llu", k, t->runs, t->failures,
+                t->total.ns, t->total.bytes);
+        for (p = 0; p < PHASES; p++) {
+            fprintf(f, " %llu", t->total.phase_ns[p]);
+        }
+        for (p = 0; p < PHASES; p++) {
+            fprintf(f, " %llu", t->total.phase_bytes[p]);
+        }
+        fprintf(f, " %.17g %.17g\n", t->min_gbps, t->max_gbps);
+    }
+    /* On disk before it replaces the old one. */
+    if (fflush(f) || fsync(fileno(f)) < 0) {
+        err = errno;
+        fclose(f);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if (fclose(f) || rename(tmp, path) < 0) {
+        err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* The session is over; a new one starts from the beginning. */
+void checkpoint_remove(const char *path) {
+    unlink(path);
+}
@@ -0,0 +1,41 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the checkpoint file of -c, from
+ * which a restarted session goes on.  See checkpoint.c.
+ *
+ */
+
+#ifndef MEMTESTER_CHECKPOINT_H
+#define MEMTESTER_CHECKPOINT_H
+
+#include <sys/types.h>
+
+#include "stats.h"
+
+/* Where a session is: the next test to run is test of loop, where 0 is
+   the stuck address test and i + 1 is entry i of the test table. */
+struct checkpoint {
+    unsigned long long seed;
+    unsigned long loop;
+    int test;
+    int exit_code;
+};
+
+/* Function declarations. */
+
+int checkpoint_load(const char *path, const char *cmd, struct checkpoint *c,
+                    struct test_stats *stats, int n);
+int checkpoint_save(const char *path, const char *cmd,
+                    const struct checkpoint *c,
+                    const struct test_stats *stats, int n);
+void checkpoint_remove(const char *path);
+
+#endif /* MEMTESTER_CHECKPOINT_H */
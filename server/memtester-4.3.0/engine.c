@@ -0,0 +1,259 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the worker pool used by do_memory_test() in memtester.c.
+ * The test region is split into one contiguous slice of bufa and bufb per
+ * worker; each worker is pinned to a CPU and runs the same test kernels from
+ * tests.c on its own slice.  engine_run() hands one job to every worker,
+ * waits for all of them and merges their results.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "engine.h"
+#include "timing.h"
+
+static pthread_key_t worker_key;
+static pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+
+static void make_worker_key(void) {
+    pthread_key_create(&worker_key, NULL);
+}
+
+/* The worker running on the calling thread, or NULL outside the pool. */
+struct worker *worker_self(void) {
+    pthread_once(&worker_key_once, make_worker_key);
+    return (struct worker *) pthread_getspecific(worker_key);
+}
+
+/* Derive the worker's generator from the session seed, the loop and the
+   test, so any single test of a run can be reproduced from the seed alone
+   (given the same thread count). */
+void worker_reseed(struct worker *w, unsigned long loop, int test) {
+    uint64_t x = w->engine->seed;
+
+    x = splitmix64(&x) ^ loop;
+    x = splitmix64(&x) ^ (uint64_t) test;
+    x = splitmix64(&x) ^ (uint64_t) w->id;
+    prng_seed(&w->rng, x);
+}
+
+/* Clear what a job accounts on the worker (eviction and phase times, and
+   its progress), at the start of each test. */
+void worker_reset_stats(struct worker *w) {
+    int i;
+
+    w->evict_ns = 0;
+    w->work_base = 0;
+    __atomic_store_n(&w->work_done, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->work_total, 0, __ATOMIC_RELAXED);
+    for (i = 0; i < PHASES; i++) {
+        w->phase_ns[i] = w->phase_bytes[i] = 0;
+    }
+}
+
+/* The calling thread's generator.  Outside the pool there is only one
+   thread (the tests are not run from anywhere else), so a shared fallback
+   state is enough. */
+struct prng *prng_self(void) {
+    static struct prng fallback = { {
+        0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL,
+        0x94d049bb133111ebULL, 0x2545f4914f6cdd1dULL
+    } };
+    struct worker *w = worker_self();
+
+    return w ? &w->rng : &fallback;
+}
+
+int engine_online_cpus(void) {
+    long n = -1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (n < 1) ? 1 : (int) n;
+}
+
+/* Pick the CPU for worker 'id': the id'th CPU we are allowed to run on,
+   wrapping around when there are more workers than CPUs. */
+static int pick_cpu(int id) {
+#ifdef CPU_SET
+    cpu_set_t allowed;
+    int cpu, n = 0, seen = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) return -1;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) n++;
+    }
+    if (!n) return -1;
+    id %= n;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && seen++ == id) return cpu;
+    }
+#endif
+    return -1;
+}
+
+static void pin_to_cpu(struct worker *w) {
+#ifdef CPU_SET
+    cpu_set_t set;
+
+    if (w->cpu < 0) return;
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    /* pid 0 is the calling thread on Linux. */
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) w->cpu = -1;
+#endif
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = (struct worker *) arg;
+    struct engine *e = w->engine;
+    unsigned long seen = 0;
+    engine_job job;
+    void *job_arg;
+    int r;
+    unsigned long long t0;
+
+    pthread_once(&worker_key_once, make_worker_key);
+    pthread_setspecific(worker_key, w);
+    pin_to_cpu(w);
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (e->generation == seen && !e->quit) {
+            pthread_cond_wait(&e->start, &e->lock);
+        }
+        if (e->quit) break;
+        seen = e->generation;
+        job = e->job;
+        job_arg = e->job_arg;
+        pthread_mutex_unlock(&e->lock);
+
+        t0 = now_ns();
+        r = w->count ? job(w, job_arg) : 0;
+        w->job_ns = now_ns() - t0;
+
+        pthread_mutex_lock(&e->lock);
+        w->result = r;
+        if (--e->pending == 0) pthread_cond_signal(&e->done);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+/* Words [*start, *end) of count are worker i's slice.  Slice boundaries
+   are kept on multiples of align words (normally one page) so that no two
+   workers ever share a page; the last worker takes the remainder. */
+void engine_slice(size_t count, int nthreads, size_t align, int i,
+                  size_t *start, size_t *end) {
+    if (!align) align = 1;
+    *start = (size_t) ((unsigned long long) count * i / nthreads);
+    *end = (size_t) ((unsigned long long) count * (i + 1) / nthreads);
+    *start -= *start % align;
+    if (i == nthreads - 1) {
+        *end = count;
+    } else {
+        *end -= *end % align;
+    }
+}
+
+/* Split count words of bufa/bufb over nthreads workers, see engine_slice().
+   Worker i is pinned to cpus[i], or if cpus is NULL to the i'th CPU we may
+   run on. */
+struct engine *engine_create(int nthreads, unsigned long volatile *bufa,
+                             unsigned long volatile *bufb, size_t count,
+                             size_t align, const int *cpus) {
+    struct engine *e;
+    struct worker *w;
+    size_t start, end;
+    int i;
+
+    if (nthreads < 1) nthreads = 1;
+    e = (struct engine *) calloc(1, sizeof(*e));
+    if (!e) return NULL;
+    e->workers = (struct worker *) calloc(nthreads, sizeof(*e->workers));
+    if (!e->workers) {
+        free(e);
+        return NULL;
+    }
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->start, NULL);
+    pthread_cond_init(&e->done, NULL);
+
+    for (i = 0; i < nthreads; i++) {
+        w = &e->workers[i];
+        engine_slice(count, nthreads, align, i, &start, &end);
+        w->id = i;
+        w->engine = e;
+        w->bufa = bufa + start;
+        w->bufb = bufb ? bufb + start : NULL;
+        w->count = end - start;
+        w->cpu = cpus ? cpus[i] : pick_cpu(i);
+        w->node = -1;
+        prng_seed(&w->rng, (uint64_t) i);
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            e->nthreads = i;
+            engine_destroy(e);
+            return NULL;
+        }
+        e->nthreads = i + 1;
+    }
+    return e;
+}
+
+/* Run job on every worker's slice and wait for all of them.  Returns 0 if
+   every worker returned 0, -1 otherwise. */
+int engine_run(struct engine *e, engine_job job, void *arg) {
+    int i, r = 0;
+
+    pthread_mutex_lock(&e->lock);
+    e->job = job;
+    e->job_arg = arg;
+    e->pending = e->nthreads;
+    e->generation++;
+    pthread_cond_broadcast(&e->start);
+    while (e->pending) {
+        pthread_cond_wait(&e->done, &e->lock);
+    }
+    for (i = 0; i < e->nthreads; i++) {
+        if (e->workers[i].result) r = -1;
+    }
+    pthread_mutex_unlock(&e->lock);
+    return r;
+}
+
+void engine_destroy(struct engine *e) {
+    int i;
+
+    if (!e) return;
+    pthread_mutex_lock(&e->lock);
+    e->quit = 1;
+    pthread_cond_broadcast(&e->start);
+    pthread_mutex_unlock(&e->lock);
+    for (i = 0; i < e->nthreads; i++) {
+        pthread_join(e->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&e->done);
+    pthread_cond_destroy(&e->start);
+    pthread_mutex_destroy(&e->lock);
+    free(e->workers);
+    free(e);
+}
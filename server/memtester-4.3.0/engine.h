@@ -0,0 +1,86 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the worker pool which runs the
+ * tests on per-thread slices of the test region.  See engine.c.
+ *
+ */
+
+#ifndef MEMTESTER_ENGINE_H
+#define MEMTESTER_ENGINE_H
+
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "prng.h"
+
+struct engine;
+struct fail_counts;
+
+/* The phases of a test that are timed separately, see stats.c. */
+#define PHASE_WRITE     0               /* filling or modifying the buffers */
+#define PHASE_VERIFY    1               /* reading them back and comparing */
+#define PHASES          2
+
+/* One worker thread and the slice of bufa/bufb it owns. */
+struct worker {
+    int id;
+    int cpu;                            /* CPU pinned to, -1 if not pinned */
+    int node;                           /* NUMA node of its slice, or -1 */
+    pthread_t thread;
+    struct engine *engine;
+    unsigned long volatile *bufa;
+    unsigned long volatile *bufb;
+    size_t count;                       /* words in each of bufa and bufb */
+    struct prng rng;                    /* this thread's random generator */
+    unsigned long long evict_ns;        /* time spent evicting (-f) */
+    unsigned long long job_ns;          /* time the last job took */
+    unsigned long long phase_ns[PHASES];    /* time and bytes moved in */
+    unsigned long long phase_bytes[PHASES]; /* each phase of the last job */
+    struct fail_counts *fails;          /* mismatches found, see failures.c */
+    unsigned long long volatile work_done;  /* words gone over in the job */
+    unsigned long long volatile work_total; /* and to go, see progress.c */
+    unsigned long long work_base;       /* work_done of the finished passes */
+    int result;
+};
+
+typedef int (*engine_job)(struct worker *w, void *arg);
+
+struct engine {
+    int nthreads;
+    struct worker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;
+    int pending;
+    int quit;
+    engine_job job;
+    void *job_arg;
+    unsigned long long seed;            /* session seed, see worker_reseed() */
+    void *ctx;                          /* the session, see session_self() */
+};
+
+/* Function declarations. */
+
+int engine_online_cpus(void);
+void engine_slice(size_t count, int nthreads, size_t align, int i,
+                  size_t *start, size_t *end);
+struct engine *engine_create(int nthreads, unsigned long volatile *bufa,
+                             unsigned long volatile *bufb, size_t count,
+                             size_t align, const int *cpus);
+int engine_run(struct engine *e, engine_job job, void *arg);
+void engine_destroy(struct engine *e);
+struct worker *worker_self(void);
+void worker_reseed(struct worker *w, unsigned long loop, int test);
+void worker_reset_stats(struct worker *w);
+struct prng *prng_self(void);
+
+#endif /* MEMTESTER_ENGINE_H */
@@ -0,0 +1,591 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the events sent to the socket client.  By default they
+ * are the text lines old clients parse.  With -E 1 every event is a frame:
+ *
+ *     'M' 'T' <version 1> <type>  <length, 4 bytes big-endian>  <payload>
+ *
+ * where type is one of the EV_* codes and the payload is a JSON object of
+ * length bytes.  Events are collected in a buffer which is written out when
+ * it fills, when the session ends, and otherwise by a flusher thread a few
+ * times a second, so a run of events costs a few large writes rather than a
+ * send() per line.  The buffer is shared by all threads of the session
+ * (failures are reported from the workers), so until the session ends it
+ * is written without waiting for the client; one that stops reading until
+ * the buffer is full is given up on.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "events.h"
+#include "timing.h"
+#include "physmap.h"
+
+#define FLUSH_MS 250
+
+#ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_DONTWAIT
+  #define MSG_DONTWAIT 0
+#endif
+
+static const char *type_names[] = {
+    "", "session-start", "allocation", "ready", "test-start", "test-end",
+    "failure", "progress", "message", "summary", "done", "failures",
+    "test-progress", "coverage", "quarantine"
+};
+
+/* Write out the buffer; the caller holds the lock.  Unless wait is set,
+   only as much as the socket takes at once is written and the rest kept,
+   so a client that stops reading never holds up the threads reporting to
+   it (workers, the progress reporter) while they hold the lock. */
+static void flush_locked(struct event_sink *s, int wait) {
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < s->len && !s->broken) {
+        n = send(s->fd, s->buf + off, s->len - off,
+                 MSG_NOSIGNAL | (wait ? 0 : MSG_DONTWAIT));
+        /* Not a socket: memtester-bench reports to stderr. */
+        if (n < 0 && errno == ENOTSOCK) {
+            n = write(s->fd, s->buf + off, s->len - off);
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && !wait && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            s->broken = 1;
+            break;
+        }
+        off += (size_t) n;
+    }
+    if (s->broken) {
+        s->len = 0;
+        return;
+    }
+    memmove(s->buf, s->buf + off, s->len - off);
+    s->len -= off;
+}
+
+/* Queue len bytes, writing out the buffer each time it fills.  A frame's
+   header has announced all of them, so none may be dropped: if the buffer
+   stays full the client has stopped reading, and it gets nothing more. */
+static void append(struct event_sink *s, const void *p, size_t len) {
+    const char *c = (const char *) p;
+    size_t n;
+
+    while (len && !s->broken) {
+        if (s->len == sizeof(s->buf)) {
+            flush_locked(s, 0);
+            if (s->len == sizeof(s->buf)) {
+                s->broken = 1;
+                s->len = 0;
+                return;
+            }
+        }
+        n = sizeof(s->buf) - s->len;
+        if (n > len) n = len;
+        memcpy(s->buf + s->len, c, n);
+        s->len += n;
+        c += n;
+        len -= n;
+    }
+}
+
+static void *flusher_main(void *arg) {
+    struct event_sink *s = (struct event_sink *) arg;
+    struct timespec until;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->running) {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += FLUSH_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&s->wake, &s->lock, &until);
+        if (s->len) flush_locked(s, 0);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+int events_open(struct event_sink *s, int fd, int mode) {
+    s->fd = fd;
+    s->mode = mode;
+    s->len = 0;
+    s->broken = 0;
+    s->running = 1;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    if (pthread_create(&s->flusher, NULL, flusher_main, s)) {
+        s->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* Send whatever is pending and stop the flusher. */
+void events_close(struct event_sink *s) {
+    pthread_mutex_lock(&s->lock);
+    if (!s->running) {
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    s->running = 0;
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->flusher, NULL);
+    events_flush(s);
+}
+
+/* Send everything pending, waiting for the client; for the end of the
+   session, once nothing else reports. */
+void events_flush(struct event_sink *s) {
+    pthread_mutex_lock(&s->lock);
+    flush_locked(s, 1);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Queue one text line (line mode) or one frame with payload json. */
+static void emit(struct event_sink *s, int type, const char *line,
+                 const char *json) {
+    unsigned char hdr[8];
+    size_t len;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->mode == EVENTS_LINES) {
+        if (line) append(s, line, strlen(line));
+    } else {
+        len = strlen(json);
+        hdr[0] = 'M';
+        hdr[1] = 'T';
+        hdr[2] = EVENTS_V1;
+        hdr[3] = (unsigned char) type;
+        hdr[4] = (unsigned char) (len >> 24);
+        hdr[5] = (unsigned char) (len >> 16);
+        hdr[6] = (unsigned char) (len >> 8);
+        hdr[7] = (unsigned char) len;
+        append(s, hdr, sizeof(hdr));
+        append(s, json, len);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Append text to out as a JSON string (with the quotes). */
+static size_t json_string(char *out, size_t size, const char *text) {
+    size_t n = 0;
+    const unsigned char *p = (const unsigned char *) text;
+
+    if (size < 3) return 0;
+    out[n++] = '"';
+    for (; *p && n + 7 < size; p++) {
+        if (*p == '"' || *p == '\\') {
+            out[n++] = '\\';
+            out[n++] = (char) *p;
+        } else if (*p == '\n') {
+            out[n++] = '\\';
+            out[n++] = 'n';
+        } else if (*p < 0x20) {
+            n += snprintf(out + n, size - n, "\\u%04x", *p);
+        } else {
+            out[n++] = (char) *p;
+        }
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+    return n;
+}
+
+static double gbps(unsigned long long bytes, unsigned long long ns) {
+    return ns ? (double) bytes / (double) ns : 0.0;
+}
+
+void ev_message(struct event_sink *s, const char *text) {
+    char json[1024];
+    size_t n;
+
+    if (s->mode != EVENTS_LINES) {
+        n = snprintf(json, sizeof(json), "{\"type\":\"%s\",\"text\":",
+                     type_names[EV_MESSAGE]);
+        n += json_string(json + n, sizeof(json) - n - 1, text);
+        strcpy(json + n, "}");
+    }
+    emit(s, EV_MESSAGE, text, json);
+}
+
+void ev_session_start(struct event_sink *s, const char *version, int bits,
+                      size_t pagesize) {
+    char json[256];
+
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"protocol\":%d,\"version\":\"%s\","
+             "\"bits\":%d,\"pagesize\":%llu}",
+             type_names[EV_SESSION_START], EVENTS_V1, version, bits,
+             (unsigned long long) pagesize);
+    emit(s, EV_SESSION_START, NULL, json);
+}
+
+void ev_allocation(struct event_sink *s, size_t bytes, size_t pagesize,
+                   const char *kind, int locked, unsigned long long ns) {
+    char json[256];
+
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"bytes\":%llu,\"pagesize\":%llu,"
+             "\"kind\":\"%s\",\"locked\":%s,\"ms\":%llu}",
+             type_names[EV_ALLOCATION], (unsigned long long) bytes,
+             (unsigned long long) pagesize, kind, locked ? "true" : "false",
+             ns / 1000000);
+    emit(s, EV_ALLOCATION, NULL, json);
+}
+
+void ev_ready(struct event_sink *s, int threads, unsigned long long seed,
+              const char *compare, int streaming, const char *evict,
+              int single, unsigned long long ns) {
+    char json[512];
+
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"threads\":%d,\"seed\":\"0x%016llx\","
+             "\"compare\":\"%s\",\"fill\":\"%s\",\"evict\":\"%s\","
+             "\"single\":%s,\"ms\":%llu}",
+             type_names[EV_READY], threads, seed, compare,
+             streaming ? "streaming" : "cached", evict ? evict : "none",
+             single ? "true" : "false", ns / 1000000);
+    emit(s, EV_READY, NULL, json);
+}
+
+void ev_test_start(struct event_sink *s, const char *name, unsigned long loop,
+                   int index) {
+    char json[256];
+
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"test\":\"%s\",\"index\":%d,\"loop\":%lu}",
+             type_names[EV_TEST_START], name, index, loop);
+    emit(s, EV_TEST_START, NULL, json);
+}
+
+/* Line mode keeps the old "  name: ok!" line, now followed by the timing. */
+void ev_test_end(struct event_sink *s, const char *name, unsigned long loop,
+                 int failed, const struct test_sample *t,
+                 unsigned long long evict_ns) {
+    char line[512], json[512], timing[256];
+    size_t n;
+
+    n = stats_format_sample(timing, sizeof(timing), t);
+    if (evict_ns && n < sizeof(timing)) {
+        snprintf(timing + n, sizeof(timing) - n, " (evict %llu of %llu ms)",
+                 evict_ns / 1000000, t->ns / 1000000);
+    }
+    snprintf(line, sizeof(line), "  %-20s: %s%s\n", name,
+             failed ? "FAILED" : "ok!", timing);
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"test\":\"%s\",\"loop\":%lu,\"ok\":%s,"
+             "\"ns\":%llu,\"bytes\":%llu,\"gbps\":%.3f,"
+             "\"write_gbps\":%.3f,\"verify_gbps\":%.3f,\"evict_ns\":%llu}",
+             type_names[EV_TEST_END], name, loop, failed ? "false" : "true",
+             t->ns, t->bytes, gbps(t->bytes, t->ns),
+             gbps(t->phase_bytes[PHASE_WRITE], t->phase_ns[PHASE_WRITE]),
+             gbps(t->phase_bytes[PHASE_VERIFY], t->phase_ns[PHASE_VERIFY]),
+             evict_ns);
+    emit(s, EV_TEST_END, line, json);
+}
+
+/* what is "mismatch", "transient" or "address line". */
+void ev_failure(struct event_sink *s, const char *what, size_t offset,
+                int phys, unsigned long long physaddr, unsigned long actual,
+                unsigned long expected) {
+    char line[256], json[384], where[64];
+
+    if (phys) {
+        snprintf(where, sizeof(where), "physical address 0x%08llx", physaddr);
+    } else {
+        snprintf(where, sizeof(where), "offset 0x%08llx",
+                 (unsigned long long) offset);
+    }
+    if (!strcmp(what, "mismatch")) {
+        snprintf(line, sizeof(line), "FAILURE: 0x%08lx != 0x%08lx at %s.\n",
+                 actual, expected, where);
+    } else if (!strcmp(what, "transient")) {
+        snprintf(line, sizeof(line),
+                 "FAILURE: transient mismatch in block at %s.\n", where);
+    } else {
+        snprintf(line, sizeof(line), "FAILURE: possible bad %s at %s.\n",
+                 what, where);
+    }
+    if (phys) {
+        snprintf(where, sizeof(where), "%llu", physaddr);
+    } else {
+        strcpy(where, "null");
+    }
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"kind\":\"%s\",\"offset\":%llu,"
+             "\"physaddr\":%s,\"actual\":\"0x%lx\",\"expected\":\"0x%lx\"}",
+             type_names[EV_FAILURE], what, (unsigned long long) offset, where,
+             actual, expected);
+    emit(s, EV_FAILURE, line, json);
+}
+
+/* Running total of a test's failures, sent instead of the failures after
+   the first few (see failures.c). */
+void ev_failures_so_far(struct event_sink *s, const char *test,
+                        unsigned long long words) {
+    char line[128], json[256];
+
+    snprintf(line, sizeof(line), "  %-20s: %llu failing words so far\n",
+             test, words);
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"test\":\"%s\",\"final\":false,"
+             "\"words\":%llu}", type_names[EV_FAILURES], test, words);
+    emit(s, EV_FAILURES, line, json);
+}
+
+static size_t json_counts(char *out, size_t size, const char *name,
+                          const unsigned long long *counts) {
+    size_t n;
+    int b;
+
+    n = snprintf(out, size, ",\"%s\":[", name);
+    for (b = 0; b < UL_LEN && n < size; b++) {
+        n += snprintf(out + n, size - n, "%s%llu", b ? "," : "", counts[b]);
+    }
+    if (n < size) n += snprintf(out + n, size - n, "]");
+    return n;
+}
+
+/* What the failure collector found in a test, once it is over. */
+void ev_failures(struct event_sink *s, const char *test,
+                 const struct fail_counts *c, size_t span, int phys,
+                 unsigned long long base, const struct physmap *map) {
+    char *line, *json;
+    size_t n, size = 8192 + 128 * (FAIL_SYNDROMES + FAIL_INTERVALS);
+    unsigned long always1, always0;
+    unsigned long long pstart, pend;
+    int i;
+
+    if (s->mode == EVENTS_LINES) {
+        if (!(line = (char *) malloc(size))) return;
+        fail_format(line, size, c, span, phys, base, map);
+        emit(s, EV_FAILURES, line, NULL);
+        free(line);
+        return;
+    }
+    if (!(json = (char *) malloc(size))) return;
+    fail_addr_bits(c, span, &always1, &always0);
+    n = snprintf(json, size,
+                 "{\"type\":\"%s\",\"test\":\"%s\",\"final\":true,"
+                 "\"words\":%llu,\"transient\":%llu,\"phys\":%s,"
+                 "\"base\":%llu,\"always1\":\"0x%lx\",\"always0\":\"0x%lx\"",
+                 type_names[EV_FAILURES], test, c->words, c->transient,
+                 phys ? "true" : "false", phys ? base : 0, always1, always0);
+    n += json_counts(json + n, size - n, "to_one", c->to_one);
+    n += json_counts(json + n, size - n, "to_zero", c->to_zero);
+    n += json_counts(json + n, size - n, "address_bits", c->addr_set);
+    n += snprintf(json + n, size - n, ",\"syndromes\":[");
+    for (i = 0; i < c->nsyndromes; i++) {
+        n += snprintf(json + n, size - n,
+                      "%s{\"xor\":\"0x%lx\",\"count\":%llu}", i ? "," : "",
+                      c->syndromes[i].xor, c->syndromes[i].count);
+    }
+    n += snprintf(json + n, size - n,
+                  "],\"other_syndromes\":%llu,\"ranges\":[",
+                  c->other_syndromes);
+    for (i = 0; i < c->nintervals; i++) {
+        n += snprintf(json + n, size - n,
+                      "%s{\"start\":%llu,\"end\":%llu,\"count\":%llu",
+                      i ? "," : "",
+                      (unsigned long long) c->intervals[i].start,
+                      (unsigned long long) c->intervals[i].end,
+                      c->intervals[i].count);
+        if (!phys && map &&
+            !physmap_lookup(map, c->intervals[i].start, &pstart) &&
+            !physmap_lookup(map, c->intervals[i].end, &pend)) {
+            n += snprintf(json + n, size - n,
+                          ",\"phys_start\":%llu,\"phys_end\":%llu",
+                          pstart, pend);
+        }
+        n += snprintf(json + n, size - n, "}");
+    }
+    snprintf(json + n, size - n, "]}");
+    emit(s, EV_FAILURES, NULL, json);
+    free(json);
+}
+
+void ev_progress(struct event_sink *s, unsigned long loop, unsigned long loops,
+                 int done, int total) {
+    char json[256];
+
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"loop\":%lu,\"loops\":%lu,\"done\":%d,"
+             "\"total\":%d}",
+             type_names[EV_PROGRESS], loop, loops, done, total);
+    emit(s, EV_PROGRESS, NULL, json);
+}
+
+/* How far the running test is, from the progress reporter.  loop_eta_ns
+   is -1 during the first loop. */
+void ev_test_progress(struct event_sink *s, const char *name,
+                      unsigned long loop, int percent,
+                      unsigned long long eta_ns, long long loop_eta_ns) {
+    char json[256];
+
+    if (s->mode == EVENTS_LINES) {
+        snprintf(json, sizeof(json), "  %-20s: %3d%%, %llus left\n", name,
+                 percent, (eta_ns + 500000000ULL) / 1000000000ULL);
+        emit(s, EV_TEST_PROGRESS, json, NULL);
+        return;
+    }
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"test\":\"%s\",\"loop\":%lu,"
+             "\"percent\":%d,\"eta_ms\":%llu,\"loop_eta_ms\":%lld}",
+             type_names[EV_TEST_PROGRESS], name, loop, percent,
+             eta_ns / 1000000, loop_eta_ns < 0 ? -1 : loop_eta_ns / 1000000);
+    emit(s, EV_TEST_PROGRESS, NULL, json);
+}
+
+/* The session's per-test table: rows in line mode, one array otherwise. */
+void ev_summary(struct event_sink *s, const struct test_stats *stats, int n) {
+    char line[256], *json;
+    size_t len, size = 256 + (size_t) n * 256;
+    int i, first = 1;
+
+    if (s->mode == EVENTS_LINES) {
+        emit(s, EV_SUMMARY, "Summary:\n", NULL);
+        stats_format_header(line, sizeof(line));
+        emit(s, EV_SUMMARY, line, NULL);
+        for (i = 0; i < n; i++) {
+            if (!stats[i].runs) continue;
+            stats_format_row(line, sizeof(line), &stats[i]);
+            emit(s, EV_SUMMARY, line, NULL);
+        }
+        return;
+    }
+    if (!(json = (char *) malloc(size))) return;
+    len = snprintf(json, size, "{\"type\":\"%s\",\"tests\":[",
+                   type_names[EV_SUMMARY]);
+    for (i = 0; i < n; i++) {
+        if (!stats[i].runs) continue;
+        len += snprintf(json + len, size - len,
+                        "%s{\"test\":\"%s\",\"runs\":%lu,\"failures\":%lu,"
+                        "\"bytes\":%llu,\"ns\":%llu,\"min_gbps\":%.3f,"
+                        "\"max_gbps\":%.3f}",
+                        first ? "" : ",", stats[i].name, stats[i].runs,
+                        stats[i].failures, stats[i].total.bytes,
+                        stats[i].total.ns, stats[i].min_gbps,
+                        stats[i].max_gbps);
+        first = 0;
+    }
+    snprintf(json + len, size - len, "]}");
+    emit(s, EV_SUMMARY, NULL, json);
+    free(json);
+}
+
+/* What a session with a time budget (-T) got done in it. */
+void ev_coverage(struct event_sink *s, const struct budget *b) {
+    char line[256], *json;
+    unsigned long long elapsed = now_ns() - b->start_ns, total = 0;
+    size_t len, size = 256 + (size_t) b->ntests * 192;
+    int i, first = 1;
+
+    for (i = 0; i < b->ntests; i++) total += budget_coverage(b, i);
+    if (s->mode == EVENTS_LINES) {
+        snprintf(line, sizeof(line), "Coverage in %llu s of %llu s, %lu runs "
+                 "skipped:\n", elapsed / 1000000000ULL,
+                 b->ns / 1000000000ULL, b->skipped);
+        emit(s, EV_COVERAGE, line, NULL);
+        for (i = 0; i < b->ntests; i++) {
+            if (!b->tests[i].runs) continue;
+            snprintf(line, sizeof(line), "  %-20s: %5lu runs, %8llu patterns "
+                     "x %lluMB\n", b->tests[i].name, b->tests[i].runs,
+                     (unsigned long long) b->tests[i].runs *
+                     b->tests[i].patterns, (unsigned long long) b->bytes >> 20);
+            emit(s, EV_COVERAGE, line, NULL);
+        }
+        snprintf(line, sizeof(line), "  %-20s: %lluMB verified\n", "total",
+                 total >> 20);
+        emit(s, EV_COVERAGE, line, NULL);
+        return;
+    }
+    if (!(json = (char *) malloc(size))) return;
+    len = snprintf(json, size, "{\"type\":\"%s\",\"budget_ms\":%llu,"
+                   "\"elapsed_ms\":%llu,\"skipped\":%lu,\"bytes\":%llu,"
+                   "\"verified_bytes\":%llu,\"tests\":[",
+                   type_names[EV_COVERAGE], b->ns / 1000000, elapsed / 1000000,
+                   b->skipped, (unsigned long long) b->bytes, total);
+    for (i = 0; i < b->ntests; i++) {
+        if (!b->tests[i].runs) continue;
+        len += snprintf(json + len, size - len,
+                        "%s{\"test\":\"%s\",\"runs\":%lu,\"patterns\":%u,"
+                        "\"verified_bytes\":%llu}",
+                        first ? "" : ",", b->tests[i].name, b->tests[i].runs,
+                        b->tests[i].patterns, budget_coverage(b, i));
+        first = 0;
+    }
+    snprintf(json + len, size - len, "]}");
+    emit(s, EV_COVERAGE, NULL, json);
+    free(json);
+}
+
+/* -b: test found added more bad pages; the tests now leave out excluded
+   bytes of the region.  full is set once no more pages are taken. */
+void ev_quarantine(struct event_sink *s, const char *test, int added,
+                   int pages, unsigned long long excluded, int full) {
+    char line[160], json[256];
+
+    snprintf(line, sizeof(line), "  %-20s: %d pages quarantined, %d in all, "
+             "%lluKB left out%s\n", test, added, pages, excluded >> 10,
+             full ? " (quarantine full)" : "");
+    snprintf(json, sizeof(json),
+             "{\"type\":\"%s\",\"test\":\"%s\",\"added\":%d,"
+             "\"pages\":%d,\"excluded_bytes\":%llu,\"full\":%s}",
+             type_names[EV_QUARANTINE], test, added, pages, excluded,
+             full ? "true" : "false");
+    emit(s, EV_QUARANTINE, line, json);
+}
+
+/* An event of process proc of -P, as it sent it (see procs.c): a line, or
+   the JSON of a frame of the given type, which gets a "proc" field. */
+void ev_relay(struct event_sink *s, int proc, int type, const char *text) {
+    size_t size = strlen(text) + 32;
+    char *out;
+
+    if (!(out = (char *) malloc(size))) return;
+    if (s->mode == EVENTS_LINES) {
+        snprintf(out, size, "[%d] %s", proc, text);
+    } else if (text[0] == '{' && text[1] != '}') {
+        snprintf(out, size, "{\"proc\":%d,%s", proc, text + 1);
+    } else {
+        snprintf(out, size, "%s", text);
+    }
+    emit(s, type, out, out);
+    free(out);
+}
+
+/* The last event of a session; sent at once. */
+void ev_done(struct event_sink *s, int exit_code) {
+    char json[128];
+
+    snprintf(json, sizeof(json), "{\"type\":\"%s\",\"exit_code\":%d}",
+             type_names[EV_DONE], exit_code);
+    emit(s, EV_DONE, "Done.\n", json);
+    events_flush(s);
+}
@@ -0,0 +1,98 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the events sent to the socket
+ * client.  See events.c for the wire format.
+ *
+ */
+
+#ifndef MEMTESTER_EVENTS_H
+#define MEMTESTER_EVENTS_H
+
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "stats.h"
+#include "failures.h"
+#include "budget.h"
+
+/* Wire formats, chosen with -E. */
+#define EVENTS_LINES    0               /* text lines, for old clients */
+#define EVENTS_V1       1               /* framed events, version 1 */
+
+/* Event types, the type byte of a v1 frame. */
+#define EV_SESSION_START    1
+#define EV_ALLOCATION       2
+#define EV_READY            3
+#define EV_TEST_START       4
+#define EV_TEST_END         5
+#define EV_FAILURE          6
+#define EV_PROGRESS         7
+#define EV_MESSAGE          8
+#define EV_SUMMARY          9
+#define EV_DONE             10
+#define EV_FAILURES         11
+#define EV_TEST_PROGRESS    12
+#define EV_COVERAGE         13
+#define EV_QUARANTINE       14
+
+#define EVENTS_BUFSIZE  (64 * 1024)
+
+struct event_sink {
+    int fd;
+    int mode;                           /* EVENTS_* */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t flusher;
+    int running;
+    int broken;                         /* the client went away */
+    size_t len;
+    char buf[EVENTS_BUFSIZE];
+};
+
+/* Function declarations. */
+
+int events_open(struct event_sink *s, int fd, int mode);
+void events_close(struct event_sink *s);
+void events_flush(struct event_sink *s);
+void ev_message(struct event_sink *s, const char *text);
+void ev_session_start(struct event_sink *s, const char *version, int bits,
+                      size_t pagesize);
+void ev_allocation(struct event_sink *s, size_t bytes, size_t pagesize,
+                   const char *kind, int locked, unsigned long long ns);
+void ev_ready(struct event_sink *s, int threads, unsigned long long seed,
+              const char *compare, int streaming, const char *evict,
+              int single, unsigned long long ns);
+void ev_test_start(struct event_sink *s, const char *name, unsigned long loop,
+                   int index);
+void ev_test_end(struct event_sink *s, const char *name, unsigned long loop,
+                 int failed, const struct test_sample *t,
+                 unsigned long long evict_ns);
+void ev_failure(struct event_sink *s, const char *what, size_t offset,
+                int phys, unsigned long long physaddr, unsigned long actual,
+                unsigned long expected);
+void ev_failures_so_far(struct event_sink *s, const char *test,
+                        unsigned long long words);
+void ev_failures(struct event_sink *s, const char *test,
+                 const struct fail_counts *c, size_t span, int phys,
+                 unsigned long long base, const struct physmap *map);
+void ev_progress(struct event_sink *s, unsigned long loop, unsigned long loops,
+                 int done, int total);
+void ev_test_progress(struct event_sink *s, const char *name,
+                      unsigned long loop, int percent,
+                      unsigned long long eta_ns, long long loop_eta_ns);
+void ev_summary(struct event_sink *s, const struct test_stats *stats, int n);
+void ev_coverage(struct event_sink *s, const struct budget *b);
+void ev_quarantine(struct event_sink *s, const char *test, int added,
+                   int pages, unsigned long long excluded, int full);
+void ev_relay(struct event_sink *s, int proc, int type, const char *text);
+void ev_done(struct event_sink *s, int exit_code);
+
+#endif /* MEMTESTER_EVENTS_H */
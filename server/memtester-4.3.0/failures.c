@@ -0,0 +1,334 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the failure collector.  A stuck data bit makes every
+ * word of the region fail, and printing each of them slows the run to a
+ * crawl while telling little more than one line could.  Instead each worker
+ * counts its mismatches into a fixed-size fail_counts:
+ *
+ *   - per data bit, how often it read as 1 and as 0 when it should not have,
+ *   - a histogram of the XOR syndromes (actual ^ expected),
+ *   - the failing offsets, coalesced into ranges (failures less than
+ *     FAIL_GAP bytes apart are one range; when the table is full a failure
+ *     widens the nearest range),
+ *   - per address bit, how many failing offsets have it set, which shows
+ *     address bits that all failures share (a bad row, column or bank).
+ *
+ * The first FAIL_DETAILS failures of a test are still sent one by one,
+ * after that a running total at most every FAIL_REPORT_MS; when the test
+ * is over the workers' counts are merged and reported in full.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "failures.h"
+#include "timing.h"
+#include "physmap.h"
+
+#define LIST_MAX 8                      /* syndromes and ranges in the text */
+
+int fail_log_init(struct fail_log *f, int nworkers) {
+    memset(f, 0, sizeof(*f));
+    f->workers = (struct fail_counts *) calloc(nworkers, sizeof(*f->workers));
+    if (!f->workers) return -1;
+    f->nworkers = nworkers;
+    return 0;
+}
+
+void fail_log_free(struct fail_log *f) {
+    free(f->workers);
+    f->workers = NULL;
+    f->nworkers = 0;
+}
+
+/* Clear the counts before a test. */
+void fail_begin(struct fail_log *f, const char *test) {
+    memset(f->workers, 0, f->nworkers * sizeof(*f->workers));
+    memset(&f->total, 0, sizeof(f->total));
+    f->test = test;
+    f->details = 0;
+    f->last_report_ns = now_ns();
+}
+
+static void add_syndrome(struct fail_counts *c, unsigned long xor,
+                         unsigned long long count) {
+    int i = c->last_syndrome;
+
+    if (i < c->nsyndromes && c->syndromes[i].xor == xor) {
+        c->syndromes[i].count += count;
+        return;
+    }
+    for (i = 0; i < c->nsyndromes; i++) {
+        if (c->syndromes[i].xor == xor) break;
+    }
+    if (i == c->nsyndromes) {
+        if (i == FAIL_SYNDROMES) {
+            c->other_syndromes += count;
+            return;
+        }
+        c->syndromes[i].xor = xor;
+        c->syndromes[i].count = 0;
+        c->nsyndromes++;
+    }
+    c->syndromes[i].count += count;
+    c->last_syndrome = i;
+}
+
+/* Bytes between [start, end] and the range iv, 0 if they touch. */
+static size_t distance(const struct fail_interval *iv, size_t start,
+                       size_t end) {
+    if (start > iv->end) return start - iv->end;
+    if (iv->start > end) return iv->start - end;
+    return 0;
+}
+
+static void add_interval(struct fail_counts *c, size_t start, size_t end,
+                         unsigned long long count) {
+    struct fail_interval *iv;
+    size_t d, best_d = (size_t) -1;
+    int i = c->last_interval, best = 0;
+
+    /* Failures mostly come in address order, so try the last range first. */
+    if (i >= c->nintervals || distance(&c->intervals[i], start, end) >=
+        FAIL_GAP) {
+        for (i = 0; i < c->nintervals; i++) {
+            d = distance(&c->intervals[i], start, end);
+            if (d < FAIL_GAP) break;
+            if (d < best_d) {
+                best_d = d;
+                best = i;
+            }
+        }
+        if (i == c->nintervals) {
+            if (i < FAIL_INTERVALS) {
+                c->intervals[i].start = start;
+                c->intervals[i].end = end;
+                c->intervals[i].count = 0;
+                c->nintervals++;
+            } else {
+                i = best; /* full: widen the nearest range */
+            }
+        }
+    }
+    iv = &c->intervals[i];
+    if (start < iv->start) iv->start = start;
+    if (end > iv->end) iv->end = end;
+    iv->count += count;
+    c->last_interval = i;
+}
+
+/* Count a word at offset which read actual instead of expected. */
+void fail_record(struct fail_counts *c, size_t offset, unsigned long actual,
+                 unsigned long expected) {
+    unsigned long x = actual ^ expected;
+    size_t o;
+    int b;
+
+    c->words++;
+    for (; x; x &= x - 1) {
+        b = __builtin_ctzl(x);
+        if ((actual >> b) & 1) {
+            c->to_one[b]++;
+        } else {
+            c->to_zero[b]++;
+        }
+    }
+    for (o = offset; o; o &= o - 1) {
+        c->addr_set[__builtin_ctzl((unsigned long) o)]++;
+    }
+    add_syndrome(c, actual ^ expected, 1);
+    add_interval(c, offset, offset, 1);
+}
+
+/* A block which differed when scanned but read back equal. */
+void fail_record_transient(struct fail_counts *c, size_t offset) {
+    c->transient++;
+    add_interval(c, offset, offset, 1);
+}
+
+/* Whether this failure is one of the first few of the test, to be sent on
+   its own.  Workers call this concurrently. */
+int fail_detail(struct fail_log *f) {
+    return __sync_fetch_and_add(&f->details, 1) < FAIL_DETAILS;
+}
+
+/* Whether a running total is due; true for one caller per interval. */
+int fail_due(struct fail_log *f) {
+    unsigned long long last = f->last_report_ns, now = now_ns();
+
+    if (now - last < (unsigned long long) FAIL_REPORT_MS * 1000000ULL) {
+        return 0;
+    }
+    return __sync_bool_compare_and_swap(&f->last_report_ns, last, now);
+}
+
+/* Failing words so far; read while the workers are still counting, so it
+   is only roughly up to date. */
+unsigned long long fail_words(const struct fail_log *f) {
+    unsigned long long n = 0;
+    int i;
+
+    for (i = 0; i < f->nworkers; i++) n += f->workers[i].words;
+    return n;
+}
+
+/* Add up the workers' counts into f->total, after the test. */
+void fail_merge(struct fail_log *f) {
+    struct fail_counts *t = &f->total, *c;
+    int i, k;
+
+    memset(t, 0, sizeof(*t));
+    for (i = 0; i < f->nworkers; i++) {
+        c = &f->workers[i];
+        t->words += c->words;
+        t->transient += c->transient;
+        for (k = 0; k < UL_LEN; k++) {
+            t->to_one[k] += c->to_one[k];
+            t->to_zero[k] += c->to_zero[k];
+            t->addr_set[k] += c->addr_set[k];
+        }
+        for (k = 0; k < c->nsyndromes; k++) {
+            add_syndrome(t, c->syndromes[k].xor, c->syndromes[k].count);
+        }
+        t->other_syndromes += c->other_syndromes;
+        for (k = 0; k < c->nintervals; k++) {
+            add_interval(t, c->intervals[k].start, c->intervals[k].end,
+                         c->intervals[k].count);
+        }
+    }
+}
+
+/* The address bits, below the size of the region (span), which are set in
+   every failing offset (always1) or in none (always0).  With only a few
+   failures every bit looks like that, so nothing is reported below 8. */
+void fail_addr_bits(const struct fail_counts *c, size_t span,
+                    unsigned long *always1, unsigned long *always0) {
+    unsigned long long words = c->words;
+    int b;
+
+    *always1 = *always0 = 0;
+    if (words < 8) return;
+    for (b = 0; b < UL_LEN && ((size_t) 1 << b) < span; b++) {
+        if (c->addr_set[b] == words) *always1 |= 1UL << b;
+        if (!c->addr_set[b]) *always0 |= 1UL << b;
+    }
+}
+
+static void append(char *buf, size_t len, size_t *n, const char *fmt, ...) {
+    va_list ap;
+    int r;
+
+    if (*n >= len) return;
+    va_start(ap, fmt);
+    r = vsnprintf(buf + *n, len - *n, fmt, ap);
+    va_end(ap);
+    if (r > 0) *n += (size_t) r < len - *n ? (size_t) r : len - *n - 1;
+}
+
+static void append_bits(char *buf, size_t len, size_t *n, const char *what,
+                        const unsigned long long *counts) {
+    int b, any = 0;
+
+    append(buf, len, n, "    %s:", what);
+    for (b = UL_LEN - 1; b >= 0; b--) {
+        if (!counts[b]) continue;
+        append(buf, len, n, " %d (%llu)", b, counts[b]);
+        any = 1;
+    }
+    append(buf, len, n, "%s\n", any ? "" : " none");
+}
+
+static void append_mask(char *buf, size_t len, size_t *n, unsigned long mask) {
+    int b;
+
+    if (!mask) append(buf, len, n, " none");
+    for (b = UL_LEN - 1; b >= 0; b--) {
+        if ((mask >> b) & 1) append(buf, len, n, " %d", b);
+    }
+}
+
+static int by_count(const void *a, const void *b) {
+    const struct fail_syndrome *x = a, *y = b;
+
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+static int by_start(const void *a, const void *b) {
+    const struct fail_interval *x = a, *y = b;
+
+    return x->start > y->start ? 1 : x->start < y->start ? -1 : 0;
+}
+
+/* The report of a test's failures, for line mode.  span is the size of the
+   region; with phys, ranges are given as physical addresses from base,
+   else as offsets, followed by their physical addresses if map has them. */
+int fail_format(char *buf, size_t len, const struct fail_counts *c,
+                size_t span, int phys, unsigned long long base,
+                const struct physmap *map) {
+    struct fail_syndrome syn[FAIL_SYNDROMES];
+    struct fail_interval iv[FAIL_INTERVALS];
+    unsigned long always1, always0;
+    unsigned long long rest, pstart, pend;
+    size_t n = 0;
+    int i;
+
+    buf[0] = '\0';
+    append(buf, len, &n, "    %llu failing words, %llu transient blocks\n",
+           c->words, c->transient);
+    append_bits(buf, len, &n, "bits read as 1", c->to_one);
+    append_bits(buf, len, &n, "bits read as 0", c->to_zero);
+
+    memcpy(syn, c->syndromes, c->nsyndromes * sizeof(syn[0]));
+    qsort(syn, c->nsyndromes, sizeof(syn[0]), by_count);
+    append(buf, len, &n, "    syndromes:");
+    for (i = 0; i < c->nsyndromes && i < LIST_MAX; i++) {
+        append(buf, len, &n, " 0x%0*lx (%llu)", UL_LEN / 4, syn[i].xor,
+               syn[i].count);
+    }
+    for (rest = c->other_syndromes; i < c->nsyndromes; i++) {
+        rest += syn[i].count;
+    }
+    if (rest) append(buf, len, &n, " and %llu more words", rest);
+    append(buf, len, &n, "%s\n", c->nsyndromes ? "" : " none");
+
+    memcpy(iv, c->intervals, c->nintervals * sizeof(iv[0]));
+    qsort(iv, c->nintervals, sizeof(iv[0]), by_start);
+    append(buf, len, &n, "    %s:", phys ? "physical addresses" : "offsets");
+    for (i = 0; i < c->nintervals && i < LIST_MAX; i++) {
+        if (!phys && map && !physmap_lookup(map, iv[i].start, &pstart) &&
+            !physmap_lookup(map, iv[i].end, &pend)) {
+            append(buf, len, &n, " 0x%08llx-0x%08llx (%llu, physical "
+                   "0x%08llx-0x%08llx)", (unsigned long long) iv[i].start,
+                   (unsigned long long) iv[i].end, iv[i].count, pstart, pend);
+            continue;
+        }
+        append(buf, len, &n, " 0x%08llx-0x%08llx (%llu)",
+               base + iv[i].start, base + iv[i].end, iv[i].count);
+    }
+    if (i < c->nintervals) {
+        append(buf, len, &n, " and %d more ranges", c->nintervals - i);
+    }
+    append(buf, len, &n, "\n");
+
+    fail_addr_bits(c, span, &always1, &always0);
+    if (always1 || always0) {
+        append(buf, len, &n, "    offset bits always 1:");
+        append_mask(buf, len, &n, always1);
+        append(buf, len, &n, ", always 0:");
+        append_mask(buf, len, &n, always0);
+        append(buf, len, &n, "\n");
+    }
+    return (int) n;
+}
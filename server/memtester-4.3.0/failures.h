@@ -0,0 +1,90 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the failure collector, which
+ * sums up the mismatches of a test instead of reporting every one of them.
+ * See failures.c.
+ *
+ */
+
+#ifndef MEMTESTER_FAILURES_H
+#define MEMTESTER_FAILURES_H
+
+#include <sys/types.h>
+
+#include "sizes.h"
+
+struct physmap;
+
+#define FAIL_DETAILS    16              /* failures of a test sent one by one */
+#define FAIL_SYNDROMES  32              /* distinct XOR syndromes counted */
+#define FAIL_INTERVALS  32              /* failing address ranges kept */
+#define FAIL_GAP        4096            /* failures this close are one range */
+#define FAIL_REPORT_MS  1000            /* running totals at most this often */
+
+/* actual ^ expected of failing words, and how often it was seen. */
+struct fail_syndrome {
+    unsigned long xor;
+    unsigned long long count;
+};
+
+/* Offsets of the first and last failing word of a range. */
+struct fail_interval {
+    size_t start;
+    size_t end;
+    unsigned long long count;
+};
+
+/* What was found in one test, by one worker or (merged) by all. */
+struct fail_counts {
+    unsigned long long words;           /* mismatching words */
+    unsigned long long transient;       /* blocks which read back equal */
+    unsigned long long to_one[UL_LEN];  /* bit read as 1, expected 0 */
+    unsigned long long to_zero[UL_LEN]; /* bit read as 0, expected 1 */
+    unsigned long long addr_set[UL_LEN];    /* failing offsets with bit set */
+    int nsyndromes;
+    int last_syndrome;
+    struct fail_syndrome syndromes[FAIL_SYNDROMES];
+    unsigned long long other_syndromes; /* words with a syndrome not kept */
+    int nintervals;
+    int last_interval;
+    struct fail_interval intervals[FAIL_INTERVALS];
+};
+
+/* A session's collector: one fail_counts per worker, so recording needs no
+   lock, and their sum once the test is over. */
+struct fail_log {
+    int nworkers;
+    struct fail_counts *workers;
+    struct fail_counts total;
+    const char *test;
+    unsigned long volatile details;     /* failures sent one by one */
+    unsigned long long volatile last_report_ns;
+};
+
+/* Function declarations. */
+
+int fail_log_init(struct fail_log *f, int nworkers);
+void fail_log_free(struct fail_log *f);
+void fail_begin(struct fail_log *f, const char *test);
+void fail_record(struct fail_counts *c, size_t offset, unsigned long actual,
+                 unsigned long expected);
+void fail_record_transient(struct fail_counts *c, size_t offset);
+int fail_detail(struct fail_log *f);
+int fail_due(struct fail_log *f);
+unsigned long long fail_words(const struct fail_log *f);
+void fail_merge(struct fail_log *f);
+void fail_addr_bits(const struct fail_counts *c, size_t span,
+                    unsigned long *always1, unsigned long *always0);
+int fail_format(char *buf, size_t len, const struct fail_counts *c,
+                size_t span, int phys, unsigned long long base,
+                const struct physmap *map);
+
+#endif /* MEMTESTER_FAILURES_H */
@@ -0,0 +1,471 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains memtester-bench, which measures how fast the kernels
+ * in tests.c run, so a change to them can be checked for regressions.  For
+ * every thread count and buffer size it first runs three baselines on the
+ * same buffers and worker pool: memcpy(), and the STREAM copy (a = b) and
+ * triad (a = b + q * c) loops.  Then the stuck address test,
+ * compare_regions() and each test of both tables in tests.c.  Every
+ * measurement is repeated for at least -m milliseconds; the best and the
+ * mean rate are printed as CSV, with the best as a percentage of each
+ * baseline.  The default sizes are half of the L1, L2 and last-level caches
+ * (the private ones times the thread count) and 4 times the last-level
+ * cache, at least 64 MB, for memory.
+ *
+ * Rates are read plus written bytes per second, counted as in the
+ * session's summary (see stats.c), so the two can be compared.
+ *
+ * With -B (and -W) the buffers come from a memory backend of memtester's
+ * -B (see backend.c) rather than from locked anonymous memory, so runs
+ * with different backends show what the backing memory costs the kernels.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE                     /* strcasestr() */
+#endif
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "sizes.h"
+#include "tests.h"
+#include "engine.h"
+#include "simd.h"
+#include "cache.h"
+#include "timing.h"
+#include "alloc.h"
+#include "backend.h"
+#include "stats.h"
+#include "events.h"
+#include "failures.h"
+#include "session.h"
+
+#define __version__ "4.3.0"
+
+#define MAX_LIST        16              /* sizes or thread counts given */
+#define DEFAULT_MIN_MS  100
+#define BENCH_SEED      0x6d656d7465737465ULL
+
+/* One row of the output. */
+struct bench {
+    const char *kind;                   /* baseline, test or single */
+    const char *name;
+    engine_job job;
+    void *arg;
+    engine_job prepare;                 /* untimed, before every run */
+};
+
+/* What the kernels expect to find through session_self(). */
+static struct session session;
+static struct event_sink events;
+static struct fail_log fails;
+
+/* -B, or NULL for locked anonymous memory. */
+static const struct backend_ops *backend;
+static struct backend_args bargs;
+
+/* Baselines.  They account their bytes like the kernels do, so
+   stats_collect() works for both. */
+static void account(struct worker *w, unsigned long long t0, size_t bytes) {
+    w->phase_ns[PHASE_WRITE] = now_ns() - t0;
+    w->phase_bytes[PHASE_WRITE] = bytes;
+}
+
+static int bench_memcpy(struct worker *w, void *arg) {
+    unsigned long long t0;
+
+    (void) arg;
+    worker_reset_stats(w);
+    t0 = now_ns();
+    memcpy((void *) w->bufa, (const void *) w->bufb, w->count * sizeof(ul));
+    account(w, t0, 2 * w->count * sizeof(ul));
+    return 0;
+}
+
+static int bench_copy(struct worker *w, void *arg) {
+    ul *a = (ul *) w->bufa;
+    const ul *b = (const ul *) w->bufb;
+    unsigned long long t0;
+    size_t i;
+
+    (void) arg;
+    worker_reset_stats(w);
+    t0 = now_ns();
+    for (i = 0; i < w->count; i++) {
+        a[i] = b[i];
+    }
+    account(w, t0, 2 * w->count * sizeof(ul));
+    return 0;
+}
+
+/* b and c are the two halves of the worker's slice of bufb. */
+static int bench_triad(struct worker *w, void *arg) {
+    size_t i, n = w->count / 2;
+    ul *a = (ul *) w->bufa;
+    const ul *b = (const ul *) w->bufb, *c = b + n;
+    ul q = 3;
+    unsigned long long t0;
+
+    (void) arg;
+    worker_reset_stats(w);
+    t0 = now_ns();
+    for (i = 0; i < n; i++) {
+        a[i] = b[i] + q * c[i];
+    }
+    account(w, t0, 3 * n * sizeof(ul));
+    return 0;
+}
+
+/* The kernels, run as do_memory_test() runs them. */
+static int bench_stuck_address(struct worker *w, void *arg) {
+    (void) arg;
+    worker_reset_stats(w);
+    if (test_stuck_address(w->bufa, w->count)) return -1;
+    return w->bufb ? test_stuck_address(w->bufb, w->count) : 0;
+}
+
+static int bench_compare(struct worker *w, void *arg) {
+    (void) arg;
+    worker_reset_stats(w);
+    return compare_regions(w->bufa, w->bufb, w->count);
+}
+
+static int bench_test(struct worker *w, void *arg) {
+    struct test *t = (struct test *) arg;
+
+    worker_reseed(w, 1, 0);
+    worker_reset_stats(w);
+    return t->fp(w->bufa, w->bufb, w->count);
+}
+
+static int bench_single_test(struct worker *w, void *arg) {
+    struct test *t = (struct test *) arg;
+
+    worker_reseed(w, 1, 0);
+    worker_reset_stats(w);
+    return t->fp(w->bufa, w->count);
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "Usage: %s [-t threads[,threads...]] "
+            "[-s size[B|K|M|G][,size...]] [-m ms] [-k name] [-n] "
+            "[-B anon|memfd|file:PATH [-W]]\n", me);
+    exit(1);
+}
+
+/* A comma-separated list of numbers, with a size suffix if shift is not
+   negative (no suffix means shift, as MB does for memtester). */
+static int parse_list(const char *arg, unsigned long long *v, int shift) {
+    const char *p = arg;
+    char *end;
+    int n = 0;
+
+    while (*p && n < MAX_LIST) {
+        errno = 0;
+        v[n] = strtoull(p, &end, 0);
+        if (errno || end == p) return -1;
+        if (shift >= 0) {
+            switch (*end) {
+                case 'G': case 'g': v[n] <<= 30; end++; break;
+                case 'M': case 'm': v[n] <<= 20; end++; break;
+                case 'K': case 'k': v[n] <<= 10; end++; break;
+                case 'B': case 'b': end++; break;
+                default: v[n] <<= shift;
+            }
+        }
+        if (!v[n] || (*end && *end != ',')) return -1;
+        n++;
+        p = *end ? end + 1 : end;
+    }
+    return n;
+}
+
+/* Which level the buffer fits in; L1 and L2 are per core. */
+static const char *level_of(size_t bytes, int threads, size_t l1, size_t l2,
+                            size_t llc) {
+    if (bytes / threads <= l1) return "L1";
+    if (bytes / threads <= l2) return "L2";
+    if (bytes <= llc) return "LLC";
+    return "DRAM";
+}
+
+/* The best rates of the baselines at the current size and thread count,
+   0 until measured. */
+struct baselines {
+    double memcpy;
+    double copy;
+    double triad;
+};
+
+static double pct(double gbps, double base) {
+    return base ? 100.0 * gbps / base : 0.0;
+}
+
+/* Run b until min_ns have passed (at least once, and not again after a
+   failure), and collect the runs into st. */
+static void measure(struct engine *e, const struct bench *b,
+                    unsigned long long min_ns, struct test_stats *st) {
+    struct test_sample sample;
+    unsigned long long start = now_ns(), t0;
+    int i, ret;
+
+    memset(st, 0, sizeof(*st));
+    st->name = b->name;
+    for (i = 0; i < e->nthreads; i++) {
+        e->workers[i].fails = &fails.workers[i];
+    }
+    session.fails = &fails;
+    do {
+        if (b->prepare) engine_run(e, b->prepare, NULL);
+        fail_begin(&fails, b->name);
+        t0 = now_ns();
+        ret = engine_run(e, b->job, b->arg);
+        stats_collect(e, now_ns() - t0, &sample);
+        stats_add(st, &sample, ret);
+    } while (now_ns() - start < min_ns && !ret);
+}
+
+static void print_row(const char *kind, const struct test_stats *st,
+                      size_t bytes, const char *level, int threads,
+                      const struct baselines *base) {
+    double mean = st->total.ns ?
+        (double) st->total.bytes / st->total.ns : 0.0;
+
+    printf("%s,%s,%llu,%s,%d,%lu,%.3f,%.3f,%.1f,%.1f,%.1f,%s\n", kind,
+           st->name, (ull) bytes, level, threads, st->runs, st->max_gbps,
+           mean, pct(st->max_gbps, base->memcpy),
+           pct(st->max_gbps, base->copy), pct(st->max_gbps, base->triad),
+           st->failures ? "FAILED" : "ok");
+    fflush(stdout);
+}
+
+static void run(struct engine *e, const struct bench *b, size_t bytes,
+                const char *level, int threads, unsigned long long min_ns,
+                const struct baselines *base) {
+    struct test_stats st;
+
+    measure(e, b, min_ns, &st);
+    print_row(b->kind, &st, bytes, level, threads, base);
+}
+
+/* Everything at one size and thread count; returns -1 if the memory could
+   not be had. */
+static int bench_size(size_t bytes, int threads, const char *only,
+                      unsigned long long min_ns, size_t l1, size_t l2,
+                      size_t llc, size_t pagesize) {
+    struct region region;
+    struct engine *dual, *single;
+    struct bench b;
+    ulv *buf;
+    size_t half, align = SIMD_BLOCK / sizeof(ul);
+    const char *level, *how;
+    struct baselines base;
+    struct test_stats st[3];
+    int i;
+
+    bytes = (bytes + pagesize - 1) & ~(pagesize - 1);
+    if (backend) {
+        if (backend->acquire(&region, bytes, &bargs, &how) < 0) {
+            fprintf(stderr, "failed to map %llu bytes (%s): %s\n",
+                    (ull) bytes, backend->name, strerror(errno));
+            return -1;
+        }
+        /* Unlocked it still runs, as the session would. */
+        backend->lock(&region, threads);
+    } else if (alloc_anon(&region, bytes, pagesize, 1, threads, NULL,
+                          NULL) < 0 &&
+               alloc_anon(&region, bytes, pagesize, 0, threads, NULL,
+                          NULL) < 0) {
+        fprintf(stderr, "failed to allocate %llu bytes: %s\n", (ull) bytes,
+                strerror(errno));
+        return -1;
+    }
+    bytes = region.bufsize;
+    buf = (ulv *) region.aligned;
+    half = bytes / 2;
+    session.test_base = region.aligned;
+    level = level_of(bytes, threads, l1, l2, llc);
+
+    dual = engine_create(threads, buf, (ulv *) ((size_t) buf + half),
+                         half / sizeof(ul), align, NULL);
+    single = engine_create(threads, buf, NULL, bytes / sizeof(ul), align,
+                           NULL);
+    if (!dual || !single || fail_log_init(&fails, threads) < 0) {
+        fprintf(stderr, "failed to start %d worker threads\n", threads);
+        exit(1);
+    }
+    dual->seed = single->seed = BENCH_SEED;
+    dual->ctx = single->ctx = &session;
+
+    /* The baselines first, so every row can be set against them. */
+    b.kind = "baseline";
+    b.arg = NULL;
+    b.prepare = NULL;
+    b.name = "memcpy";
+    b.job = bench_memcpy;
+    measure(dual, &b, min_ns, &st[0]);
+    b.name = "copy";
+    b.job = bench_copy;
+    measure(dual, &b, min_ns, &st[1]);
+    b.name = "triad";
+    b.job = bench_triad;
+    measure(dual, &b, min_ns, &st[2]);
+    base.memcpy = st[0].max_gbps;
+    base.copy = st[1].max_gbps;
+    base.triad = st[2].max_gbps;
+    for (i = 0; i < 3; i++) {
+        print_row(b.kind, &st[i], bytes, level, threads, &base);
+    }
+
+    /* The comparison tests expect bufa and bufb to hold the same. */
+    b.kind = "test";
+    b.prepare = bench_copy;
+    b.name = "Stuck Address";
+    b.job = bench_stuck_address;
+    if (!only || strcasestr(b.name, only)) {
+        run(dual, &b, bytes, level, threads, min_ns, &base);
+    }
+    b.name = "compare_regions";
+    b.job = bench_compare;
+    if (!only || strcasestr(b.name, only)) {
+        run(dual, &b, bytes, level, threads, min_ns, &base);
+    }
+    b.job = bench_test;
+    for (i = 0; tests[i].name; i++) {
+        b.name = tests[i].name;
+        b.arg = &tests[i];
+        if (only && !strcasestr(b.name, only)) continue;
+        run(dual, &b, bytes, level, threads, min_ns, &base);
+    }
+    b.kind = "single";
+    b.prepare = NULL;
+    b.job = bench_single_test;
+    for (i = 0; single_tests[i].name; i++) {
+        b.name = single_tests[i].name;
+        b.arg = &single_tests[i];
+        if (only && !strcasestr(b.name, only)) continue;
+        run(single, &b, bytes, level, threads, min_ns, &base);
+    }
+
+    fail_log_free(&fails);
+    session.fails = NULL;
+    engine_destroy(single);
+    engine_destroy(dual);
+    if (backend) {
+        backend->release(&region);
+    } else {
+        alloc_release(&region);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned long long sizes[MAX_LIST], threads[MAX_LIST], v[MAX_LIST];
+    unsigned long long min_ms = DEFAULT_MIN_MS;
+    size_t l1, l2, llc, pagesize = (size_t) sysconf(_SC_PAGESIZE);
+    const char *only = NULL;
+    char *end;
+    int nsizes = 0, nthreads = 0, n, opt, i, j, cpus;
+    unsigned long long last;
+
+    while ((opt = getopt(argc, argv, "t:s:m:k:nB:W")) != -1) {
+        switch (opt) {
+            case 't':
+                if ((nthreads = parse_list(optarg, threads, -1)) < 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 's':
+                if ((nsizes = parse_list(optarg, sizes, 20)) < 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'm':
+                errno = 0;
+                min_ms = strtoull(optarg, &end, 0);
+                if (errno || *end) usage(argv[0]);
+                break;
+            case 'k':
+                only = optarg;
+                break;
+            case 'n':
+                session.use_nt_stores = 1;
+                break;
+            case 'B':
+                /* "mem" needs -p, which only the session has. */
+                backend = backend_find(optarg, &bargs);
+                if (!backend || backend->physical) usage(argv[0]);
+                break;
+            case 'W':
+                bargs.overwrite = 1;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc) usage(argv[0]);
+    bargs.pagesize = pagesize;
+
+    simd_init();
+    cache_init();
+    l1 = cache_size(1) ? cache_size(1) : 32 << 10;
+    l2 = cache_size(2) ? cache_size(2) : 256 << 10;
+    llc = cache_llc_size();
+    cpus = engine_online_cpus();
+    if (!nthreads) {
+        threads[nthreads++] = 1;
+        if (cpus > 1) threads[nthreads++] = (ull) cpus;
+    }
+
+    cancel_init(&session.cancel);
+    if (events_open(&events, STDERR_FILENO, EVENTS_LINES) < 0) {
+        fprintf(stderr, "failed to start the event flusher\n");
+        return 1;
+    }
+    session.events = &events;
+
+    printf("# memtester-bench " __version__ " (%d-bit), %s compare, %s fill, "
+           "L1 %lluK, L2 %lluK, LLC %lluK, %d cpus, %s memory\n", UL_LEN,
+           simd->name, session.use_nt_stores ? "streaming" : "cached",
+           (ull) l1 >> 10, (ull) l2 >> 10, (ull) llc >> 10, cpus,
+           backend ? backend->name : "anonymous");
+    printf("kind,name,bytes,level,threads,runs,best_gbps,mean_gbps,"
+           "memcpy_pct,copy_pct,triad_pct,result\n");
+    for (i = 0; i < nthreads; i++) {
+        n = nsizes;
+        if (nsizes) {
+            memcpy(v, sizes, nsizes * sizeof(v[0]));
+        } else {
+            /* One size per level, the private caches per thread. */
+            v[n++] = (ull) l1 / 2 * threads[i];
+            v[n++] = (ull) l2 / 2 * threads[i];
+            v[n++] = (ull) llc / 2;
+            v[n++] = (ull) llc * 4 < (64 << 20) ? (64 << 20) : (ull) llc * 4;
+        }
+        for (j = 0, last = 0; j < n; j++) {
+            /* Skip default sizes which fall behind the previous one. */
+            if (!nsizes && v[j] <= last) continue;
+            last = v[j];
+            bench_size((size_t) v[j], (int) threads[i], only,
+                       min_ms * 1000000ULL, l1, l2, llc, pagesize);
+        }
+    }
+    events_close(&events);
+    cancel_destroy(&session.cancel);
+    return 0;
+}
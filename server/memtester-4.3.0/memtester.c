@@ -21,9 +21,13 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#ifdef __BIONIC__
+#include <getopt.h>                     /* optreset */
+#endif
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <netinet/in.h>
 #include <sys/socket.h>
@@ -37,50 +41,44 @@
 #include "types.h"
 #include "sizes.h"
 #include "tests.h"
+#include "engine.h"
+#include "simd.h"
+#include "cache.h"
+#include "timing.h"
+#include "alloc.h"
+#include "numa.h"
+#include "stats.h"
+#include "events.h"
+#include "failures.h"
+#include "progress.h"
+#include "budget.h"
+#include "checkpoint.h"
+#include "physmap.h"
+#include "badpages.h"
+#include "procs.h"
+#include "backend.h"
+#include "session.h"
 
 #define EXIT_FAIL_NONSTARTER    0x01
 #define EXIT_FAIL_ADDRESSLINES  0x02
 #define EXIT_FAIL_OTHERTEST     0x04
+#define EXIT_FAIL_SCREEN        0x08
 
 #define SOCKET_NAME "memorytester"
 static char default_arg[] = "-p 10M";
-#define DEF_NUM 5
 #define LOG_TAG "memorytester"
 #define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__))
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__))
 #define LOGW(...) ((void)__android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__))
 #define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__))
 
-struct test tests[] = {
-    { "Random Value", test_random_value },
-    { "Compare XOR", test_xor_comparison },
-    { "Compare SUB", test_sub_comparison },
-    { "Compare MUL", test_mul_comparison },
-    { "Compare DIV",test_div_comparison },
-    { "Compare OR", test_or_comparison },
-    { "Compare AND", test_and_comparison },
-    { "Sequential Increment", test_seqinc_comparison },
-    { "Solid Bits", test_solidbits_comparison },
-    { "Block Sequential", test_blockseq_comparison },
-    { "Checkerboard", test_checkerboard_comparison },
-    { "Bit Spread", test_bitspread_comparison },
-    { "Bit Flip", test_bitflip_comparison },
-    { "Walking Ones", test_walkbits1_comparison },
-    { "Walking Zeroes", test_walkbits0_comparison },
-#ifdef TEST_NARROW_WRITES    
-    { "8-bit Writes", test_8bit_wide_random },
-    { "16-bit Writes", test_16bit_wide_random },
-#endif
-    { NULL, NULL }
+/* What one engine_run() of a test needs to know. */
+struct test_run {
+    struct test *test;
+    ul loop;
+    int index;
 };
 
-typedef struct
-{
-    int argc;
-    void **argv;
-    int socket_fd;
-}PARAM;
-
 /* Sanity checks and portability helper macros. */
 #ifdef _SC_VERSION
 void check_posix_system(void) {
@@ -111,6 +109,21 @@ int memtester_pagesize(void) {
 }
 #endif
 
+/* Default seed for the test data when none is given with -r. */
+ull memtester_seed(void) {
+    ull seed = 0;
+    int fd = open("/dev/urandom", O_RDONLY);
+
+    if (fd >= 0) {
+        if (read(fd, &seed, sizeof(seed)) != sizeof(seed)) seed = 0;
+        close(fd);
+    }
+    if (!seed) {
+        seed = ((ull) time(NULL) << 20) ^ (ull) getpid();
+    }
+    return seed;
+}
+
 /* Some systems don't define MAP_LOCKED.  Define it to 0 here
    so it's just a no-op when ORed with other constants. */
 #ifndef MAP_LOCKED
@@ -118,57 +131,59 @@ int memtester_pagesize(void) {
 #endif
 
 /* Function declarations */
-void usage(char *me);
-void *stop_memtester(void *arg);
-void *do_memory_test(void *arg);
+int usage(struct session *s, char *me);
+int run_session(struct session *s);
+int do_memory_test(struct session *s);
+int run_kernel(struct worker *w, int (*fp)(), ulv *bufa, ulv *bufb,
+               size_t count);
+int run_stuck_address(struct worker *w, void *arg);
+int run_test(struct worker *w, void *arg);
+int run_single_test(struct worker *w, void *arg);
+int run_screen(struct worker *w, void *arg);
+ull max_evict_ns(struct engine *e);
+void account_nodes(struct engine *e, struct numa_plan *plan);
+void report_stopped(struct event_sink *events, const char *name);
+void report_failures(struct session *s, struct fail_log *f, size_t bufsize);
+void report_skipped(struct event_sink *events, struct budget *b, int i);
+int quick_screen(struct session *s, struct engine *e, struct fail_log *fails,
+                 struct progress *progress, size_t bufsize);
+void save_checkpoint(struct session *s, const char *path,
+                     const struct checkpoint *c,
+                     const struct test_stats *stats, int n, int *error);
+void report_quarantine(struct session *s, const char *test, const char *path,
+                       size_t offb, size_t count, int *error);
+int events_mode(int argc, char **argv);
+int parse_size(const char *arg, char **end, ull *bytes);
+int parse_ranges(const char *arg, struct procs_share *ranges,
+                 size_t pagesize);
 
-/* Global vars - so tests have access to this information */
-int use_phys = 0;
-off_t physaddrbase = 0;
-pthread_t do_memory_test_thread, stop_memtester_thread;
+/* getopt() keeps its state in globals; sessions parse one at a time. */
+static pthread_mutex_t getopt_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Function definitions */
-void usage(char *me) {
-    LOGD("Usage: %s [-p physaddrbase [-d device]] <mem>[B|K|M|G] [loops]\n",me);
-    exit(EXIT_FAIL_NONSTARTER);
-}
+int usage(struct session *s, char *me) {
+    char buffer[512];
 
-int cmd_split(char **arg, char *params){
-    int num = 0;
-    char *word = params;
-
-    if((params == NULL) || (*params == '\0')){
-        return 0;
-    }
-    arg[num] = params;
-    LOGD("params:%s\n", params);
-    for(word = params; ((word != NULL)&&(*word != '\0')); ++word){
-        if(*word == ' '){
-            *word = '\0';
-            if((*(word+1) != ' ') && (*(word+1) != '\0') && ((word+1) != NULL) && (num < (DEF_NUM*2-1))){
-                num++;
-                arg[num] = (word+1);
-            }
-        }
-    }
-    return (num + 1);
+    sprintf(buffer, "Usage: %s [-p physaddrbase[:size][,...] [-d device] "
+            "[-C uc|wc|cached]] [-B anon|memfd|file:PATH|mem [-W]] "
+            "[-t threads] [-s] [-r seed] [-n] [-f] [-H auto|off|1G,2M,thp] [-N] [-E 0|1] "
+            "[-T time[s|m|h]] [-q] [-c checkpoint] [-b badpages] "
+            "[-P processes] <mem>[B|K|M|G] [loops]\n", me);
+    LOGD("%s", buffer);
+    ev_message(s->events, buffer);
+    return EXIT_FAIL_NONSTARTER;
 }
 
 int main(int argc, char ** argv) {
     int connect_number = 6;
-    int fdListen = -1, new_fd = -1;
+    int fdListen = -1;
     int ret;
-    struct sockaddr_un peeraddr;
-    socklen_t socklen = sizeof (peeraddr);
-    int numbytes;
-    char buff[256];
-    int key = -1;
-    int argcs;
-    int len;
-    char* cmd;
-    char* argvs[20];
-    int i = 0;
-    PARAM param;
+
+    /* A process of a -P session only runs that session, see procs.c. */
+    if (argc == 3 && !strcmp(argv[1], PROCS_CHILD)) {
+        ret = session_run(PROCS_FD, argv[2], run_session);
+        return ret < 0 ? EXIT_FAIL_NONSTARTER : ret;
+    }
 
     // get the socket define in init.rc
     fdListen = android_get_control_socket(SOCKET_NAME);
@@ -186,127 +201,413 @@ int main(int argc, char ** argv) {
          exit(-1);
     }
 
-    while(1){
-        //wait for client
-        new_fd = accept(fdListen, (struct sockaddr *) &peeraddr, &socklen);
-        LOGD("Accept_fd %d",new_fd);
+    /* Each client gets a session of its own; this only returns on error. */
+    session_serve(fdListen, run_session, default_arg);
+    LOGD("session loop failed errno:%d,%s", errno, strerror(errno));
+    exit(-1);
+}
 
-        if(new_fd < 0){
-            LOGD("accept errno:%d,%s", errno, strerror(errno));
-            exit(-1);
-        }
+/* One client's run, on its own thread.  The event stream outlives the
+   test so that setup errors reach the client too. */
+int run_session(struct session *s) {
+    struct event_sink events;
+    int exit_code;
 
-        if((numbytes = recv(new_fd,buff,sizeof(buff),0))==-1){
-            LOGD("recv errno:%d,%s", errno, strerror(errno));
-        }
+    LOGD("session %d: %s\n", s->id, s->cmd);
+    if (events_open(&events, s->fd, events_mode(s->argc, s->argv)) < 0) {
+        LOGD("failed to set up the event stream\n");
+        return EXIT_FAIL_NONSTARTER;
+    }
+    s->events = &events;
+    exit_code = do_memory_test(s);
+    LOGD("Done.\n");
+    ev_done(&events, exit_code);
+    events_close(&events);
+    s->events = NULL;
+    return exit_code;
+}
 
-        LOGD("%s", buff);
+/* The wire format (-E) has to be known before the first line is sent, so
+   it is looked up ahead of getopt(); getopt() checks the value. */
+int events_mode(int argc, char **argv) {
+    const char *v = NULL;
+    int i;
 
-        LOGD("receive command, do memory test");
-        /* if from client parameter is null, use default command */
-        if(buff == NULL || *buff == '\0'){
-            len = strlen(default_arg);
-        }else{
-            len = strlen(buff);
-        }
-        cmd = (char *) malloc(len + 1);
-        if(buff == NULL || *buff == '\0'){
-            strcpy(cmd, default_arg);
-        }else{
-            strcpy(cmd, buff);
-        }
-        argcs = cmd_split(argvs, cmd);
-        for(i = 0; i < argcs; i ++){
-            LOGD("argvs[%d] = %d\n", i, argvs[i]);
+    for (i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "-E", 2)) {
+            v = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[i + 1] : NULL);
         }
-        ret =  pthread_create(&stop_memtester_thread, NULL, stop_memtester, new_fd);
-        if(ret != 0){
-            LOGD("create stop thread failed!");
-            exit(-1);
+    }
+    return (v && atoi(v) == EVENTS_V1) ? EVENTS_V1 : EVENTS_LINES;
+}
+
+/* Parse a size such as the memory argument: a number with a B, K, M or G
+   suffix, MB if it has none.  *end is set past it; returns -1 if there is
+   no number or it overflows. */
+int parse_size(const char *arg, char **end, ull *bytes) {
+    ull raw;
+    int shift;
+
+    errno = 0;
+    raw = strtoull(arg, end, 0);
+    if (errno != 0 || *end == arg) return -1;
+    switch (**end) {
+        case 'G':
+        case 'g':
+            shift = 30; /* gigabytes */
+            (*end)++;
+            break;
+        case 'M':
+        case 'm':
+            shift = 20; /* megabytes */
+            (*end)++;
+            break;
+        case 'K':
+        case 'k':
+            shift = 10; /* kilobytes */
+            (*end)++;
+            break;
+        case 'B':
+        case 'b':
+            shift = 0; /* bytes*/
+            (*end)++;
+            break;
+        default:  /* no suffix */
+            shift = 20; /* megabytes */
+    }
+    if (raw > (~0ULL >> shift)) return -1;
+    *bytes = raw << shift;
+    return 0;
+}
+
+/* Parse the -p list of physical ranges, base[:size][,base[:size]...] with
+   hex bases on page boundaries; a range without a size gets the memory
+   argument (bytes 0 here).  Returns how many there are, or -1. */
+int parse_ranges(const char *arg, struct procs_share *ranges,
+                 size_t pagesize) {
+    char *end;
+    int n = 0;
+
+    for (;;) {
+        if (n == PROCS_MAX) return -1;
+        errno = 0;
+        ranges[n].phys = strtoull(arg, &end, 16);
+        ranges[n].bytes = 0;
+        if (errno != 0 || end == arg ||
+            (ranges[n].phys & (pagesize - 1))) {
+            return -1;
         }
-        param.argc = argcs;
-        param.argv = argvs;
-        param.socket_fd = new_fd;
-        ret = pthread_create(&do_memory_test_thread, NULL, do_memory_test, &param);
-        if(do_memory_test_thread != 0){
-            pthread_join(do_memory_test_thread, NULL);
-            LOGD("memory test thread is finish, so continue..");
+        if (*end == ':' && (parse_size(end + 1, &end, &ranges[n].bytes) < 0 ||
+                            ranges[n].bytes < pagesize ||
+                            ranges[n].bytes > (size_t) -1)) {
+            return -1;
         }
-        LOGD("memory test is finish, close socket connect ....");
-        close(new_fd);
+        n++;
+        if (*end == '\0') return n;
+        if (*end != ',') return -1;
+        arg = end + 1;
     }
 }
 
-void *stop_memtester(void *arg) {
-    int client_socket;
-    int numbytes;
-    int ret = -1;
-    char buff[256] = {0};
-    client_socket = (int)arg;
-    while(1){
-        memset(buff, sizeof(buff), 0);
-        if((numbytes = recv(client_socket, buff, sizeof(buff), 0))==-1){
-            LOGD("recv errno:%d,%s", errno, strerror(errno));
-            exit(-1);
+/* Run the kernel fp on count words of bufa and bufb, or of bufa alone if
+   bufb is NULL.  With -b it is run on each part of them that is on no
+   quarantined page, see badpages.c; a kernel that went on past its
+   failures has still failed. */
+int run_kernel(struct worker *w, int (*fp)(), ulv *bufa, ulv *bufb,
+               size_t count) {
+    struct session *s = session_self();
+    size_t offa, offb, start, end = 0;
+    int r = 0;
+
+    if (!s->badpages) return bufb ? fp(bufa, bufb, count) : fp(bufa, count);
+    offa = (size_t) bufa - (size_t) s->test_base;
+    offb = bufb ? (size_t) bufb - (size_t) s->test_base : BADPAGES_NONE;
+    while (badpages_next(s->badpages, offa, offb, count, &start, &end)) {
+        if (bufb ? fp(bufa + start, bufb + start, end - start) :
+            fp(bufa + start, end - start)) {
+            r = -1;
         }
-        LOGD("receive message : %s\n", buff);
-        ret = strcmp(buff, "stop\n");
-        LOGD("ret = %d\n", ret);
-        if(ret == 0){
-            LOGD("receive stop memory test messge, we exit()");
-            exit(0);
+    }
+    return (r || w->fails->words || w->fails->transient) ? -1 : 0;
+}
+
+/* Engine jobs: each worker runs a test on its own slice of bufa/bufb. */
+int run_stuck_address(struct worker *w, void *arg) {
+    (void) arg;
+    worker_reset_stats(w);
+    if (run_kernel(w, test_stuck_address, w->bufa, NULL, w->count)) {
+        return -1;
+    }
+    return w->bufb ? run_kernel(w, test_stuck_address, w->bufb, NULL,
+                                w->count) : 0;
+}
+
+int run_test(struct worker *w, void *arg) {
+    struct test_run *run = (struct test_run *) arg;
+
+    worker_reseed(w, run->loop, run->index);
+    worker_reset_stats(w);
+    return run_kernel(w, run->test->fp, w->bufa, w->bufb, w->count);
+}
+
+int run_single_test(struct worker *w, void *arg) {
+    struct test_run *run = (struct test_run *) arg;
+
+    worker_reseed(w, run->loop, run->index);
+    worker_reset_stats(w);
+    return run_kernel(w, run->test->fp, w->bufa, NULL, w->count);
+}
+
+/* -q: the screen covers both halves, like the stuck address test. */
+int run_screen(struct worker *w, void *arg) {
+    struct test_run *run = (struct test_run *) arg;
+
+    worker_reseed(w, 0, run->index);
+    worker_reset_stats(w);
+    if (run_kernel(w, run->test->fp, w->bufa, NULL, w->count)) {
+        return -1;
+    }
+    return w->bufb ? run_kernel(w, run->test->fp, w->bufb, NULL, w->count) :
+                     0;
+}
+
+/* The workers evict in parallel, so the slowest one is what the eviction
+   added to the test's run time. */
+ull max_evict_ns(struct engine *e) {
+    ull max = 0;
+    int i;
+
+    for (i = 0; i < e->nthreads; i++) {
+        if (e->workers[i].evict_ns > max) max = e->workers[i].evict_ns;
+    }
+    return max;
+}
+
+/* -N: charge what each worker did in the last engine_run() to its node.
+   A node's workers run in parallel, so its slowest one sets the time. */
+void account_nodes(struct engine *e, struct numa_plan *plan) {
+    struct numa_node *n;
+    struct worker *w;
+    ull ns[NUMA_MAX_NODES];
+    int i;
+
+    memset(ns, 0, plan->topo->nnodes * sizeof(ns[0]));
+    for (i = 0; i < e->nthreads; i++) {
+        w = &e->workers[i];
+        n = &plan->topo->nodes[plan->node[i]];
+        n->bytes += (ull) w->count * sizeof(ul) * (w->bufb ? 2 : 1);
+        if (w->result) n->failed = 1;
+        if (w->job_ns > ns[plan->node[i]]) ns[plan->node[i]] = w->job_ns;
+    }
+    for (i = 0; i < plan->topo->nnodes; i++) {
+        plan->topo->nodes[i].ns += ns[i];
+    }
+}
+
+/* A test cut short by stop; what it did so far is not counted. */
+void report_stopped(struct event_sink *events, const char *name) {
+    char buffer[64];
+
+    LOGD("stopped\n");
+    sprintf(buffer, "  %-20s: stopped\n", name);
+    ev_message(events, buffer);
+}
+
+/* Once a test is over: what its failures had in common, if there were any. */
+void report_failures(struct session *s, struct fail_log *f, size_t bufsize) {
+    fail_merge(f);
+    if (!f->total.words && !f->total.transient) return;
+    ev_failures(s->events, f->test, &f->total, bufsize, s->use_phys,
+                (ull) s->physaddrbase, s->physmap);
+}
+
+/* -T: test i is expected to take longer than the time left. */
+void report_skipped(struct event_sink *events, struct budget *b, int i) {
+    char buffer[128];
+
+    budget_skip(b);
+    LOGD("  %-20s: skipped\n", b->tests[i].name);
+    sprintf(buffer, "  %-20s: skipped, needs %.1f s, %.1f s left\n",
+            b->tests[i].name, budget_estimate(b, i) / 1e9,
+            budget_left(b) / 1e9);
+    ev_message(events, buffer);
+}
+
+/* -q: run the screen tests before the first loop; returns -1 as soon as
+   one of them fails.  They are reported like the tests of a loop, as loop
+   0, but are not part of the summary.  progress is NULL if not reporting. */
+int quick_screen(struct session *s, struct engine *e, struct fail_log *fails,
+                 struct progress *progress, size_t bufsize) {
+    struct event_sink *events = s->events;
+    struct test_sample sample;
+    struct test_run run;
+    ull test_start, test_ns;
+    int i, ret;
+
+    LOGD("Quick screen:\n");
+    ev_message(events, "Quick screen:\n");
+    for (i = 0; screen_tests[i].name; i++) {
+        if (cancel_point(&s->cancel)) break;
+        s->test = screen_tests[i].name;
+        LOGD("  %-20s: ", screen_tests[i].name);
+        run.test = &screen_tests[i];
+        run.loop = 0;
+        run.index = i;
+        ev_test_start(events, screen_tests[i].name, 0, i);
+        fail_begin(fails, screen_tests[i].name);
+        if (progress) progress_test(progress, screen_tests[i].name);
+        test_start = now_ns();
+        ret = engine_run(e, run_screen, &run);
+        test_ns = now_ns() - test_start;
+        if (progress) progress_test_end(progress);
+        if (s->cancel.state == CANCEL_STOP) {
+            report_stopped(events, screen_tests[i].name);
+            break;
         }
+        stats_collect(e, test_ns, &sample);
+        LOGD("%s\n", ret ? "FAILED" : "ok");
+        ev_test_end(events, screen_tests[i].name, 0, ret, &sample,
+                    s->evict_caches ? max_evict_ns(e) : 0);
+        report_failures(s, fails, bufsize);
+        if (ret) return -1;
+    }
+    return 0;
+}
+
+/* -c: write where the session is.  A failure is reported once per errno,
+   as the next save may well fail the same way. */
+void save_checkpoint(struct session *s, const char *path,
+                     const struct checkpoint *c,
+                     const struct test_stats *stats, int n, int *error) {
+    char buffer[512];
+
+    if (!checkpoint_save(path, s->cmd, c, stats, n)) {
+        *error = 0;
+        return;
     }
+    if (errno == *error) return;
+    *error = errno;
+    LOGD("failed to write checkpoint %s: %s\n", path, strerror(errno));
+    snprintf(buffer, sizeof(buffer), "failed to write checkpoint %s: %s\n",
+             path, strerror(errno));
+    ev_message(s->events, buffer);
 }
 
-void *do_memory_test(void *arg) {
-    int argc, client_socket;
-    char **argv;
-    PARAM* param = (PARAM *)arg;
+/* -b: after a test, tell the client about the pages it quarantined and
+   write the set to path.  The tests leave out count words from the start
+   of the region and, unless offb is BADPAGES_NONE, from offb. */
+void report_quarantine(struct session *s, const char *test, const char *path,
+                       size_t offb, size_t count, int *error) {
+    struct badpages *b = s->badpages;
+    char buffer[512];
+
+    if (!b || b->count == b->saved) return;
+    LOGD("  %-20s: %d pages quarantined\n", test, b->count - b->saved);
+    ev_quarantine(s->events, test, b->count - b->saved, b->count,
+                  badpages_excluded(b, offb, count), b->full);
+    if (!badpages_save(b, path, s->use_phys, (ull) s->physaddrbase,
+                       s->physmap)) {
+        *error = 0;
+        return;
+    }
+    if (errno == *error) return;
+    *error = errno;
+    LOGD("failed to write bad pages %s: %s\n", path, strerror(errno));
+    snprintf(buffer, sizeof(buffer), "failed to write bad pages %s: %s\n",
+             path, strerror(errno));
+    ev_message(s->events, buffer);
+}
+
+int do_memory_test(struct session *s) {
+    int argc = s->argc;
+    char **argv = s->argv;
+    struct event_sink *events = s->events;
     ul loops, loop, i;
-    size_t pagesize, wantraw, wantmb, wantbytes, wantbytes_orig, bufsize,
+    size_t pagesize, wantmb, wantbytes, wantbytes_orig, bufsize,
          halflen, count;
-    char *memsuffix, *addrsuffix, *loopsuffix;
+    char *memsuffix, *loopsuffix, *threadsuffix, *seedsuffix;
     ptrdiff_t pagesizemask;
-    void volatile *buf, *aligned;
+    void volatile *aligned;
     ulv *bufa, *bufb;
     int do_mlock = 1, done_mem = 0;
     int exit_code = 0;
-    int memfd, opt, memshift;
+    int opt, ret, argi, bad = 0;
+    ull wantraw;
     size_t maxbytes = -1; /* addressable memory, in bytes */
     size_t maxmb = (maxbytes >> 20) + 1; /* addressable memory, in MB */
     /* Device to mmap memory from with -p, default is normal core */
     char *device_name = "/dev/mem";
     struct stat statbuf;
     int device_specified = 0;
+    int cache = PHYS_UNCACHED, cache_specified = 0; /* -C */
+    struct procs_share ranges[PROCS_MAX]; /* -p */
+    int nranges = 0;
+    const char *how;
+    const struct backend_ops *backend = NULL; /* -B */
+    struct backend_args bargs = { 0 };
     char *env_testmask = 0;
     ul testmask = 0;
     char buffer[4096];
-    int start_test_flag = -1;
+    int nthreads = 0; /* worker threads, 0 = all online CPUs */
+    struct engine *engine = NULL;
+    int single = 0; /* -s: single-buffer computed-expectation mode */
+    struct test *table;
+    engine_job job;
+    struct test_run run;
+    ull test_start, test_ns;
+    ull session_start = now_ns(), alloc_start, alloc_ns;
+    struct test_sample sample;
+    struct test_stats *summary = NULL; /* [0] is the stuck address test */
+    int ntests, nenabled, done; /* tests in the table, run per loop, run */
+    ull seed = 0;
+    int seed_specified = 0;
+    int huge = HUGE_AUTO; /* -H: which huge page kinds to try */
+    int use_numa = 0; /* -N: per-node slices, workers and results */
+    struct numa_topology topo;
+    struct numa_plan plan = { 0 };
+    struct numa_node *node;
+    struct region region;
+    struct fail_log fails = { 0 };
+    struct progress progress;
+    int reporting = 0;
+    size_t limit = 0;
+    const char *limit_why;
+    ull budget_ns = 0; /* -T: the session's time budget, 0 = none */
+    int quick = 0; /* -q: screen the region before the first loop */
+    char *checkpoint_path = NULL; /* -c: where to keep the checkpoint */
+    struct checkpoint cp;
+    int resumed = 0, cp_error = 0;
+    int skip_to = 0; /* tests of the first loop already run, see -c */
+    ul first_loop = 1;
+    struct physmap physmap = { 0 };
+    char *badpages_path = NULL; /* -b: where to keep the bad pages */
+    struct badpages badpages = { 0 };
+    size_t offb;
+    int bp_error = 0;
+    int nprocs = 1; /* -P: processes to split the test over */
+    struct budget budget = { 0 };
 
-    argc = param->argc;
-    argv = param->argv;
-    client_socket = param->socket_fd;
     LOGD("memtester version " __version__ " (%d-bit)\n", UL_LEN);
     memset(buffer, sizeof(buffer), 0);
     sprintf(buffer, "memtester version " __version__ " (%d-bit)\n", UL_LEN);
-    send(client_socket, buffer, strlen(buffer), 0);
+    ev_message(events, buffer);
     LOGD("Copyright (C) 2001-2012 Charles Cazabon.\n");
     memset(buffer, sizeof(buffer), 0);
     sprintf(buffer, "Copyright (C) 2001-2012 Charles Cazabon.\n");
-    send(client_socket, buffer, strlen(buffer), 0);
+    ev_message(events, buffer);
     LOGD("Licensed under the GNU General Public License version 2 (only).\n");
     memset(buffer, sizeof(buffer), 0);
     sprintf(buffer, "Licensed under the GNU General Public License version 2 (only).\n");
-    send(client_socket, buffer, strlen(buffer), 0);
+    ev_message(events, buffer);
     LOGD("\n");
     check_posix_system();
     pagesize = memtester_pagesize();
     pagesizemask = (ptrdiff_t) ~(pagesize - 1);
+    ev_session_start(events, __version__, UL_LEN, pagesize);
     LOGD("pagesizemask is 0x%tx\n", pagesizemask);
     memset(buffer, sizeof(buffer), 0);
     sprintf(buffer, "pagesizemask is 0x%tx\n", pagesizemask);
-    send(client_socket, buffer, strlen(buffer), 0);
+    ev_message(events, buffer);
     
     /* If MEMTESTER_TEST_MASK is set, we use its value as a mask of which
        tests we run.
@@ -317,301 +618,862 @@ void *do_memory_test(void *arg) {
         if (errno) {
             LOGD(stderr, "error parsing MEMTESTER_TEST_MASK %s: %s\n", 
                     env_testmask, strerror(errno));
-            usage(argv[0]); /* doesn't return */
+            return usage(s, argv[0]);
         }
         LOGD("using testmask 0x%lx\n", testmask);
     }
 
-    while ((opt = getopt(argc, argv, "p:d:")) != -1) {
+    pthread_mutex_lock(&getopt_lock);
+#ifdef __BIONIC__
+    optreset = 1;
+    optind = 1;
+#else
+    optind = 0; /* glibc: start over, also forgetting the last argv */
+#endif
+    while (!bad && (opt = getopt(argc, argv, "p:d:C:B:Wt:sr:nfH:NE:T:qc:b:P:")) != -1) {
         switch (opt) {
             case 'p':
-                errno = 0;
-                physaddrbase = (off_t) strtoull(optarg, &addrsuffix, 16);
-                if (errno != 0) {
+                nranges = parse_ranges(optarg, ranges, pagesize);
+                if (nranges < 0) {
                     LOGD(stderr,
                             "failed to parse physaddrbase arg; should be hex "
-                            "address (0x123...)\n");
-                    usage(argv[0]); /* doesn't return */
-                }
-                if (*addrsuffix != '\0') {
-                    /* got an invalid character in the address */
-                    LOGD(stderr,
-                            "failed to parse physaddrbase arg; should be hex "
-                            "address (0x123...)\n");
-                    usage(argv[0]); /* doesn't return */
-                }
-                if (physaddrbase & (pagesize - 1)) {
-                    LOGD(stderr,
-                            "bad physaddrbase arg; does not start on page "
-                            "boundary\n");
-                    usage(argv[0]); /* doesn't return */
+                            "addresses on page boundaries, each with an "
+                            "optional size (0x123...[:64M],...)\n");
+                    bad = 1;
+                    break;
                 }
                 /* okay, got address */
-                use_phys = 1;
+                s->physaddrbase = (off_t) ranges[0].phys;
+                s->use_phys = 1;
                 break;
             case 'd':
-                if (stat(optarg,&statbuf)) {
+                if (!strcmp(optarg, PHYS_MEMFD)) {
+                    /* an anonymous memory file stands in for the device */
+                    device_name = optarg;
+                    device_specified = 1;
+                } else if (stat(optarg,&statbuf)) {
                     LOGD(stderr, "can not use %s as device: %s\n", optarg, 
                             strerror(errno));
-                    usage(argv[0]); /* doesn't return */
+                    bad = 1;
                 } else {
-                    if (!S_ISCHR(statbuf.st_mode)) {
+                    if (!S_ISCHR(statbuf.st_mode) &&
+                        !S_ISREG(statbuf.st_mode)) {
                         LOGD(stderr, "can not mmap non-char device %s\n", 
                                 optarg);
-                        usage(argv[0]); /* doesn't return */
+                        bad = 1;
                     } else {
                         device_name = optarg;
                         device_specified = 1;
                     }
                 }
                 break;              
+            case 'C':
+                cache = alloc_parse_cache(optarg);
+                if (cache < 0) {
+                    LOGD("unknown cache attribute %s\n", optarg);
+                    sprintf(buffer, "unknown cache attribute %s\n", optarg);
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                cache_specified = 1;
+                break;
+            case 'B':
+                backend = backend_find(optarg, &bargs);
+                if (!backend) {
+                    LOGD("unknown memory backend %s\n", optarg);
+                    sprintf(buffer, "unknown memory backend %s\n", optarg);
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                break;
+            case 'W':
+                bargs.overwrite = 1;
+                break;
+            case 't':
+                errno = 0;
+                nthreads = (int) strtoul(optarg, &threadsuffix, 0);
+                if (errno != 0 || *threadsuffix != '\0' || nthreads < 1) {
+                    LOGD("failed to parse number of threads\n");
+                    sprintf(buffer, "failed to parse number of threads\n");
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                break;
+            case 's':
+                single = 1;
+                break;
+            case 'r':
+                errno = 0;
+                seed = strtoull(optarg, &seedsuffix, 0);
+                if (errno != 0 || *seedsuffix != '\0') {
+                    LOGD("failed to parse seed\n");
+                    sprintf(buffer, "failed to parse seed\n");
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                seed_specified = 1;
+                break;
+            case 'n':
+                s->use_nt_stores = 1;
+                break;
+            case 'f':
+                s->evict_caches = 1;
+                break;
+            case 'H':
+                huge = alloc_parse_huge(optarg);
+                if (huge < 0) {
+                    LOGD("failed to parse huge page policy\n");
+                    sprintf(buffer, "failed to parse huge page policy\n");
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                break;
+            case 'N':
+                use_numa = 1;
+                break;
+            case 'E':
+                /* Already applied by events_mode(). */
+                if (strcmp(optarg, "0") && strcmp(optarg, "1")) {
+                    LOGD("unknown event protocol %s\n", optarg);
+                    sprintf(buffer, "unknown event protocol %s\n", optarg);
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                break;
+            case 'T':
+                if (budget_parse(optarg, &budget_ns) < 0) {
+                    LOGD("failed to parse time budget\n");
+                    sprintf(buffer, "failed to parse time budget\n");
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                break;
+            case 'q':
+                quick = 1;
+                break;
+            case 'c':
+                checkpoint_path = optarg;
+                break;
+            case 'b':
+                badpages_path = optarg;
+                break;
+            case 'P':
+                errno = 0;
+                nprocs = (int) strtol(optarg, &threadsuffix, 0);
+                if (errno || *threadsuffix || nprocs < 1 ||
+                    nprocs > PROCS_MAX) {
+                    LOGD("processes must be 1 to %d\n", PROCS_MAX);
+                    sprintf(buffer, "processes must be 1 to %d\n", PROCS_MAX);
+                    ev_message(events, buffer);
+                    bad = 1;
+                }
+                break;
             default: /* '?' */
-                usage(argv[0]); /* doesn't return */
+                bad = 1;
         }
     }
+    argi = optind;
+    pthread_mutex_unlock(&getopt_lock);
+    if (bad) return usage(s, argv[0]);
+
+    if (nprocs > 1 && s->use_phys) {
+        LOGD("-P can not be used with a physical address (-p)\n");
+        sprintf(buffer, "-P can not be used with a physical address (-p)\n");
+        ev_message(events, buffer);
+        return usage(s, argv[0]);
+    }
+
+    if (use_numa && s->use_phys) {
+        LOGD("-N can not be used with a physical address (-p)\n");
+        sprintf(buffer, "-N can not be used with a physical address (-p)\n");
+        ev_message(events, buffer);
+        return usage(s, argv[0]);
+    }
+
+    /* -p is tested through the "mem" backend, and only through it. */
+    if (backend && backend->physical != s->use_phys) {
+        LOGD("-B mem, and only it, goes with -p\n");
+        sprintf(buffer, "-B mem, and only it, goes with -p\n");
+        ev_message(events, buffer);
+        return usage(s, argv[0]);
+    }
+    if (s->use_phys) backend = backend_find("mem", &bargs);
 
-    if (device_specified && !use_phys) {
+    /* -N places the pages of its own anonymous region. */
+    if (use_numa && backend) {
+        LOGD("-N can not be used with -B\n");
+        sprintf(buffer, "-N can not be used with -B\n");
+        ev_message(events, buffer);
+        return usage(s, argv[0]);
+    }
+
+    /* The processes of -P would all test the same named file. */
+    if (nprocs > 1 && bargs.path && !s->use_phys &&
+        (stat(bargs.path, &statbuf) || !S_ISDIR(statbuf.st_mode))) {
+        LOGD("with -P, -B file needs a directory\n");
+        sprintf(buffer, "with -P, -B file needs a directory\n");
+        ev_message(events, buffer);
+        return usage(s, argv[0]);
+    }
+
+    if ((device_specified || cache_specified) && !s->use_phys) {
         LOGD(stderr, 
                 "for mem device, physaddrbase (-p) must be specified\n");
-        usage(argv[0]); /* doesn't return */
+        return usage(s, argv[0]);
     }
     
-    if (optind >= argc) {
+    if (argi >= argc) {
         LOGD(stderr, "need memory argument, in MB\n");
-        usage(argv[0]); /* doesn't return */
+        return usage(s, argv[0]);
     }
 
-    errno = 0;
-    wantraw = (size_t) strtoul(argv[optind], &memsuffix, 0);
-    if (errno != 0) {
+    if (parse_size(argv[argi], &memsuffix, &wantraw) < 0 ||
+        *memsuffix != '\0') {
         LOGD(stderr, "failed to parse memory argument");
-        usage(argv[0]); /* doesn't return */
+        return usage(s, argv[0]);
     }
-    switch (*memsuffix) {
-        case 'G':
-        case 'g':
-            memshift = 30; /* gigabytes */
-            break;
-        case 'M':
-        case 'm':
-            memshift = 20; /* megabytes */
-            break;
-        case 'K':
-        case 'k':
-            memshift = 10; /* kilobytes */
-            break;
-        case 'B':
-        case 'b':
-            memshift = 0; /* bytes*/
-            break;
-        case '\0':  /* no suffix */
-            memshift = 20; /* megabytes */
-            break;
-        default:
-            /* bad suffix */
-            usage(argv[0]); /* doesn't return */
+    for (i = 0; i < (ul) nranges; i++) {
+        if (!ranges[i].bytes) ranges[i].bytes = wantraw;
     }
-    wantbytes_orig = wantbytes = ((size_t) wantraw << memshift);
+    /* A range of its own size is tested instead of the memory argument. */
+    if (nranges == 1) wantraw = ranges[0].bytes;
+    if (wantraw > (size_t) -1) {
+        LOGD("This system can only address %llu MB.\n", (ull) maxmb);
+        sprintf(buffer, "This system can only address %llu MB.\n",
+                (ull) maxmb);
+        ev_message(events, buffer);
+        return EXIT_FAIL_NONSTARTER;
+    }
+    /* -P: the memory is split over processes, each of which can lock its
+       share; this session only runs them.  Several -p ranges are tested
+       the same way, one process per range. */
+    if (nprocs > 1 || nranges > 1) {
+        if (nranges > 1) {
+            nprocs = nranges;
+        } else if (procs_split(ranges, nprocs, wantraw, pagesize) < 0) {
+            sprintf(buffer, "can not split %lluMB over %d processes\n",
+                    wantraw >> 20, nprocs);
+            ev_message(events, buffer);
+            return EXIT_FAIL_NONSTARTER;
+        }
+        if (procs_run(s, nprocs, argi, ranges, nranges > 1, nthreads,
+                      &exit_code)) {
+            exit_code |= EXIT_FAIL_NONSTARTER;
+        }
+        return exit_code;
+    }
+    wantbytes_orig = wantbytes = (size_t) wantraw;
     wantmb = (wantbytes_orig >> 20);
-    optind++;
+    argi++;
     if (wantmb > maxmb) {
         LOGD(stderr, "This system can only address %llu MB.\n", (ull) maxmb);
-        exit(EXIT_FAIL_NONSTARTER);
+        return EXIT_FAIL_NONSTARTER;
     }
     if (wantbytes < pagesize) {
         LOGD(stderr, "bytes %ld < pagesize %ld -- memory argument too large?\n",
                 wantbytes, pagesize);
-        exit(EXIT_FAIL_NONSTARTER);
+        return EXIT_FAIL_NONSTARTER;
     }
 
-    if (optind >= argc) {
+    if (argi >= argc) {
         loops = 0;
     } else {
         errno = 0;
-        loops = strtoul(argv[optind], &loopsuffix, 0);
+        loops = strtoul(argv[argi], &loopsuffix, 0);
         if (errno != 0) {
             LOGD(stderr, "failed to parse number of loops");
-            usage(argv[0]); /* doesn't return */
+            return usage(s, argv[0]);
         }
         if (*loopsuffix != '\0') {
             LOGD(stderr, "loop suffix %c\n", *loopsuffix);
-            usage(argv[0]); /* doesn't return */
+            return usage(s, argv[0]);
         }
     }
 
     LOGD("want %lluMB (%llu bytes)\n", (ull) wantmb, (ull) wantbytes);
     memset(buffer, sizeof(buffer), 0);
     sprintf(buffer, "want %lluMB (%llu bytes)\n", (ull) wantmb, (ull) wantbytes);
-    send(client_socket, buffer, strlen(buffer), 0);
-    buf = NULL;
-
-    if (use_phys) {
-        memfd = open(device_name, O_RDWR | O_SYNC);
-        if (memfd == -1) {
-            LOGD(stderr, "failed to open %s for physical memory: %s\n",
-                    device_name, strerror(errno));
-            exit(EXIT_FAIL_NONSTARTER);
+    ev_message(events, buffer);
+    memset(&region, 0, sizeof(region));
+    if (use_numa && numa_discover(&topo) < 0) {
+        LOGD("no NUMA nodes found, testing without -N\n");
+        sprintf(buffer, "no NUMA nodes found, testing without -N\n");
+        ev_message(events, buffer);
+        use_numa = 0;
+    }
+    if (use_numa) {
+        /* One worker per CPU by default, spread evenly over the nodes. */
+        nthreads = numa_plan_create(&plan, &topo, nthreads);
+        if (nthreads < 0) {
+            LOGD("out of memory\n");
+            numa_free(&topo);
+            return EXIT_FAIL_NONSTARTER;
+        }
+        plan.single = single;
+        plan.align = pagesize / sizeof(ul);
+    }
+    /* The worker threads also fault in and lock the region. */
+    if (!nthreads) nthreads = engine_online_cpus();
+    alloc_start = now_ns();
+
+    /* -B (or -p): the region comes from the backend, as it is. */
+    if (backend) {
+        if (s->use_phys) bargs.path = device_name;
+        bargs.base = s->physaddrbase;
+        bargs.cache = cache;
+        bargs.pagesize = pagesize;
+        if (backend->acquire(&region, wantbytes, &bargs, &how) < 0) {
+            LOGD("failed to map %s memory: %s\n", backend->name,
+                    strerror(errno));
+            if (s->use_phys) {
+                sprintf(buffer, "failed to mmap %s for physical memory: "
+                        "%s\n", device_name, strerror(errno));
+            } else {
+                sprintf(buffer, "failed to map %s memory: %s%s\n",
+                        backend->name, strerror(errno), errno == EEXIST ?
+                        " (-W tests it anyway)" : "");
+            }
+            ev_message(events, buffer);
+            exit_code = EXIT_FAIL_NONSTARTER;
+            goto out;
         }
-        buf = (void volatile *) mmap(0, wantbytes, PROT_READ | PROT_WRITE,
-                                     MAP_SHARED | MAP_LOCKED, memfd,
-                                     physaddrbase);
-        if (buf == MAP_FAILED) {
-            LOGD(stderr, "failed to mmap %s for physical memory: %s\n",
-                    device_name, strerror(errno));
-            exit(EXIT_FAIL_NONSTARTER);
+        if (s->use_phys) {
+            sprintf(buffer, "mapped %s from 0x%llx, %s\n", device_name,
+                    (ull) s->physaddrbase, how);
+        } else {
+            sprintf(buffer, "got  %lluMB (%llu bytes) on %llu kB pages "
+                    "(%s)\n", (ull) region.bufsize >> 20,
+                    (ull) region.bufsize, (ull) region.pagesize >> 10, how);
         }
+        ev_message(events, buffer);
 
-        if (mlock((void *) buf, wantbytes) < 0) {
+        if (backend->lock(&region, nthreads) < 0) {
             LOGD(stderr, "failed to mlock mmap'ed space\n");
+            sprintf(buffer, "mlock failed: %s\n", strerror(errno));
+            ev_message(events, buffer);
             do_mlock = 0;
         }
 
-        bufsize = wantbytes; /* accept no less */
-        aligned = buf;
+        aligned = region.aligned;
+        bufsize = region.bufsize; /* accept no less */
         done_mem = 1;
     }
 
-    while (!done_mem) {
-        while (!buf && wantbytes) {
-            buf = (void volatile *) malloc(wantbytes);
-            if (!buf) wantbytes -= pagesize;
+    /* A region kept locked by an earlier session saves mapping and locking
+       it again.  -N binds the pages of its region itself, so it always
+       gets a new one. */
+    if (!done_mem && use_numa) alloc_drop_kept();
+    if (!done_mem && !use_numa &&
+        !alloc_reuse(&region, wantbytes, huge, pagesize)) {
+        LOGD("reusing %lluMB (%s) locked by an earlier session\n",
+                (ull) region.bufsize >> 20, alloc_kind_name(region.kind));
+        sprintf(buffer, "got  %lluMB (%llu bytes), reusing the region locked "
+                "by an earlier session (%s)\n", (ull) region.bufsize >> 20,
+                (ull) region.bufsize, alloc_kind_name(region.kind));
+        ev_message(events, buffer);
+        aligned = region.aligned;
+        bufsize = region.bufsize;
+        done_mem = 1;
+    }
+
+    /* Huge pages first; if they are unavailable or can't be locked, fall
+       back to small pages below, which knows how to shrink the request.
+       hugetlb pages come from their own pool, but transparent huge pages
+       are ordinary memory, so only try those if the request fits. */
+    if (!done_mem) limit = alloc_lock_limit(&limit_why);
+    if (!done_mem && wantbytes > limit) huge &= ~HUGE_THP;
+    if (!done_mem && huge && !alloc_huge(&region, wantbytes, huge)) {
+        LOGD("got  %lluMB (%llu bytes) on %llu kB pages (%s), trying mlock ...",
+                (ull) region.bufsize >> 20, (ull) region.bufsize,
+                (ull) region.pagesize >> 10, alloc_kind_name(region.kind));
+        memset(buffer, sizeof(buffer), 0);
+        sprintf(buffer, "got  %lluMB (%llu bytes) on %llu kB pages (%s)\n",
+                (ull) region.bufsize >> 20, (ull) region.bufsize,
+                (ull) region.pagesize >> 10, alloc_kind_name(region.kind));
+        ev_message(events, buffer);
+        plan.pagesize = region.pagesize;
+        if ((use_numa &&
+             numa_bind_slices(region.aligned, region.bufsize, &plan) < 0) ||
+            alloc_populate(region.aligned, region.bufsize, region.pagesize,
+                           nthreads) < 0) {
+            LOGD("failed: %s, falling back to small pages\n", strerror(errno));
+            memset(buffer, sizeof(buffer), 0);
+            sprintf(buffer, "mlock failed: %s, falling back to small pages\n",
+                    strerror(errno));
+            ev_message(events, buffer);
+            alloc_release(&region);
+        } else {
+            LOGD("locked.\n");
+            memset(buffer, sizeof(buffer), 0);
+            sprintf(buffer, "locked.\n");
+            ev_message(events, buffer);
+            aligned = region.aligned;
+            bufsize = region.bufsize;
+            done_mem = 1;
         }
-        bufsize = wantbytes;
-        LOGD("got  %lluMB (%llu bytes)", (ull) wantbytes >> 20,(ull) wantbytes);
+    }
+
+    plan.pagesize = pagesize;
+    if (!done_mem) {
+        if (wantbytes > limit) {
+            LOGD("can lock at most %lluMB (%s), reducing...\n",
+                    (ull) limit >> 20, limit_why);
+            memset(buffer, sizeof(buffer), 0);
+            sprintf(buffer, "can lock at most %lluMB (%s), reducing...\n",
+                    (ull) limit >> 20, limit_why);
+            ev_message(events, buffer);
+            wantbytes = limit;
+        }
+        LOGD("trying mlock ...");
         memset(buffer, sizeof(buffer), 0);
-        sprintf(buffer, "got  %lluMB (%llu bytes)\n", (ull) wantbytes >> 20,(ull) wantbytes);
-        send(client_socket, buffer, strlen(buffer), 0);
-        fflush(stdout);
-        if (do_mlock) {
-            LOGD(", trying mlock ...");
+        sprintf(buffer, "trying mlock ...\n");
+        ev_message(events, buffer);
+        if (!alloc_anon(&region, wantbytes, pagesize, 1, nthreads,
+                        use_numa ? numa_bind_slices : NULL, &plan)) {
+            LOGD("locked.\n");
             memset(buffer, sizeof(buffer), 0);
-            sprintf(buffer, "trying mlock ...\n");
-            send(client_socket, buffer, strlen(buffer), 0);
-            fflush(stdout);
-            if ((size_t) buf % pagesize) {
-                /* printf("aligning to page -- was 0x%tx\n", buf); */
-                aligned = (void volatile *) ((size_t) buf & pagesizemask) + pagesize;
-                /* printf("  now 0x%tx -- lost %d bytes\n", aligned,
-                 *      (size_t) aligned - (size_t) buf);
-                 */
-                bufsize -= ((size_t) aligned - (size_t) buf);
-            } else {
-                aligned = buf;
-            }
-            /* Try mlock */
-            if (mlock((void *) aligned, bufsize) < 0) {
-                switch(errno) {
-                    case EAGAIN: /* BSDs */
-                        LOGD("over system/pre-process limit, reducing...\n");
-                        memset(buffer, sizeof(buffer), 0);
-                        sprintf(buffer, "over system/pre-process limit, reducing...\n");
-                        send(client_socket, buffer, strlen(buffer), 0);
-                        free((void *) buf);
-                        buf = NULL;
-                        wantbytes -= pagesize;
-                        break;
-                    case ENOMEM:
-                        LOGD("too many pages, reducing...\n");
-                        memset(buffer, sizeof(buffer), 0);
-                        sprintf(buffer, "too many pages, reducing...\n");
-                        send(client_socket, buffer, strlen(buffer), 0);
-                        free((void *) buf);
-                        buf = NULL;
-                        wantbytes -= pagesize;
-                        break;
-                    case EPERM:
-                        LOGD("insufficient permission.\n");
-                        memset(buffer, sizeof(buffer), 0);
-                        sprintf(buffer, "insufficient permission.");
-                        send(client_socket, buffer, strlen(buffer), 0);
-                        LOGD("Trying again, unlocked:\n");
-                        memset(buffer, sizeof(buffer), 0);
-                        sprintf(buffer, "Trying again, unlocked:\n");
-                        send(client_socket, buffer, strlen(buffer), 0);
-                        do_mlock = 0;
-                        free((void *) buf);
-                        buf = NULL;
-                        wantbytes = wantbytes_orig;
-                        break;
-                    default:
-                        LOGD("failed for unknown reason.\n");
-                        memset(buffer, sizeof(buffer), 0);
-                        sprintf(buffer, "failed for unknown reason.\n");
-                        send(client_socket, buffer, strlen(buffer), 0);
-                        do_mlock = 0;
-                        done_mem = 1;
-                }
+            sprintf(buffer, "locked.\n");
+            ev_message(events, buffer);
+        } else {
+            if (errno == EPERM) {
+                LOGD("insufficient permission.\n");
+                memset(buffer, sizeof(buffer), 0);
+                sprintf(buffer, "insufficient permission.");
+                ev_message(events, buffer);
             } else {
-                LOGD("locked.\n");
+                LOGD("failed: %s\n", strerror(errno));
                 memset(buffer, sizeof(buffer), 0);
-                sprintf(buffer, "locked.\n");
-                send(client_socket, buffer, strlen(buffer), 0);
-                done_mem = 1;
+                sprintf(buffer, "failed: %s\n", strerror(errno));
+                ev_message(events, buffer);
+            }
+            LOGD("Trying again, unlocked:\n");
+            memset(buffer, sizeof(buffer), 0);
+            sprintf(buffer, "Trying again, unlocked:\n");
+            ev_message(events, buffer);
+            do_mlock = 0;
+            if (alloc_anon(&region, wantbytes_orig, pagesize, 0, nthreads,
+                           use_numa ? numa_bind_slices : NULL, &plan)) {
+                LOGD("failed to allocate memory: %s\n", strerror(errno));
+                sprintf(buffer, "failed to allocate memory: %s\n",
+                        strerror(errno));
+                ev_message(events, buffer);
+                exit_code = EXIT_FAIL_NONSTARTER;
+                goto out;
             }
-        } else {
-            done_mem = 1;
-            printf("\n");
         }
+        aligned = region.aligned;
+        bufsize = region.bufsize;
+        LOGD("got  %lluMB (%llu bytes)", (ull) bufsize >> 20, (ull) bufsize);
+        memset(buffer, sizeof(buffer), 0);
+        sprintf(buffer, "got  %lluMB (%llu bytes)\n", (ull) bufsize >> 20,
+                (ull) bufsize);
+        ev_message(events, buffer);
+        done_mem = 1;
     }
 
     if (!do_mlock) LOGD(stderr, "Continuing with unlocked memory; testing "
                            "will be slower and less reliable.\n");
+    alloc_ns = now_ns() - alloc_start;
+    ev_allocation(events, bufsize, region.pagesize ? region.pagesize : pagesize,
+                  alloc_kind_name(region.kind), do_mlock, alloc_ns);
+
+    if (single) {
+        /* The whole region is one buffer. */
+        count = bufsize / sizeof(ul);
+        bufa = (ulv *) aligned;
+        bufb = NULL;
+        table = single_tests;
+        job = run_single_test;
+    } else {
+        halflen = bufsize / 2;
+        count = halflen / sizeof(ul);
+        bufa = (ulv *) aligned;
+        bufb = (ulv *) ((size_t) aligned + halflen);
+        table = tests;
+        job = run_test;
+    }
+    s->test_base = aligned;
+
+    /* Without -p, failures are given as physical addresses through the
+       pagemap of the region.  That needs its pages to stay put. */
+    if (!s->use_phys && do_mlock) {
+        if (!(backend ? backend->translate(&region, &physmap) :
+              physmap_build(&physmap, aligned, bufsize))) {
+            s->physmap = &physmap;
+            LOGD("physical addresses from pagemap, %d ranges\n",
+                    physmap.nruns);
+            sprintf(buffer, "physical addresses from pagemap, %d ranges\n",
+                    physmap.nruns);
+        } else {
+            LOGD("no physical addresses: %s\n", strerror(errno));
+            sprintf(buffer, "no physical addresses for failures: %s\n",
+                    errno == EPERM ? "page frames not readable "
+                    "(needs CAP_SYS_ADMIN)" : strerror(errno));
+        }
+        ev_message(events, buffer);
+    }
+
+    /* -b: leave out the pages an earlier session found bad, and from here
+       on every page that fails. */
+    offb = bufb ? (size_t) halflen : BADPAGES_NONE;
+    if (badpages_path) {
+        if (badpages_init(&badpages, bufsize, pagesize) < 0) {
+            LOGD("out of memory\n");
+            exit_code = EXIT_FAIL_NONSTARTER;
+            goto out;
+        }
+        if (badpages_load(&badpages, badpages_path) < 0 && errno != ENOENT) {
+            LOGD("not reading bad pages %s: %s\n", badpages_path,
+                    strerror(errno));
+            sprintf(buffer, "not reading bad pages: %s\n", strerror(errno));
+            ev_message(events, buffer);
+        }
+        badpages_place(&badpages, s->use_phys, (ull) s->physaddrbase,
+                       s->physmap);
+        badpages.saved = badpages.count;
+        s->badpages = &badpages;
+        LOGD("quarantine: %d of %d bad pages in the region\n",
+                badpages.count, badpages.nphys);
+        sprintf(buffer, "quarantine: %d of %d known bad pages in the region, "
+                "%lluKB left out%s\n", badpages.count, badpages.nphys,
+                badpages_excluded(&badpages, offb, count) >> 10,
+                (s->use_phys || s->physmap) ? "" :
+                "; no physical addresses, so pages found are not kept");
+        ev_message(events, buffer);
+    }
 
-    halflen = bufsize / 2;
-    count = halflen / sizeof(ul);
-    bufa = (ulv *) aligned;
-    bufb = (ulv *) ((size_t) aligned + halflen);
+    /* Per-test throughput over the whole session, sent at the end. */
+    for (ntests = 0; table[ntests].name; ntests++);
+    summary = (struct test_stats *) calloc(ntests + 1, sizeof(*summary));
+    if (!summary) {
+        LOGD("out of memory\n");
+        exit_code = EXIT_FAIL_NONSTARTER;
+        goto out;
+    }
+    summary[0].name = "Stuck Address";
+    nenabled = 1;
+    for (i = 0; i < (ul) ntests; i++) {
+        summary[i + 1].name = table[i].name;
+        if (!testmask || ((1 << i) & testmask)) nenabled++;
+    }
 
-    for(loop=1; ((!loops) || loop <= loops); loop++) {
+    if (budget_ns) {
+        if (budget_init(&budget, session_start, budget_ns,
+                        (size_t) count * sizeof(ul) * (bufb ? 2 : 1),
+                        ntests + 1) < 0) {
+            LOGD("out of memory\n");
+            exit_code = EXIT_FAIL_NONSTARTER;
+            goto out;
+        }
+        budget_test(&budget, 0, "Stuck Address", 16);
+        for (i = 0; i < (ul) ntests; i++) {
+            budget_test(&budget, i + 1, table[i].name,
+                        (!testmask || ((1 << i) & testmask)) ?
+                        table[i].patterns : 0);
+        }
+    }
+
+    engine = engine_create(nthreads, bufa, bufb, count, pagesize / sizeof(ul),
+                           use_numa ? plan.cpu : NULL);
+    if (!engine) {
+        LOGD("failed to start %d worker threads\n", nthreads);
+        exit_code = EXIT_FAIL_NONSTARTER;
+        goto out;
+    }
+    engine->ctx = s;
+    if (fail_log_init(&fails, nthreads) < 0) {
+        LOGD("out of memory\n");
+        exit_code = EXIT_FAIL_NONSTARTER;
+        goto out;
+    }
+    for (i = 0; i < (ul) nthreads; i++) {
+        engine->workers[i].fails = &fails.workers[i];
+    }
+    s->fails = &fails;
+    reporting = !progress_start(&progress, engine, events);
+    LOGD("using %d threads\n", nthreads);
+    sprintf(buffer, "using %d threads\n", nthreads);
+    ev_message(events, buffer);
+    if (use_numa) {
+        for (i = 0; i < (ul) nthreads; i++) {
+            node = &topo.nodes[plan.node[i]];
+            engine->workers[i].node = node->id;
+            node->bytes += (ull) engine->workers[i].count * sizeof(ul) *
+                (bufb ? 2 : 1);
+        }
+        for (i = 0; i < (ul) topo.nnodes; i++) {
+            node = &topo.nodes[i];
+            LOGD("node %d: %lluMB, %d cpus\n", node->id, node->bytes >> 20,
+                    node->ncpus);
+            sprintf(buffer, "node %d: %lluMB, %d cpus\n", node->id,
+                    node->bytes >> 20, node->ncpus);
+            ev_message(events, buffer);
+            node->bytes = 0;
+        }
+    }
+
+    /* -c: go on from where an earlier session with this command was, with
+       its seed and totals. */
+    if (checkpoint_path &&
+        !checkpoint_load(checkpoint_path, s->cmd, &cp, summary, ntests + 1)) {
+        resumed = 1;
+        seed = cp.seed;
+        seed_specified = 1;
+        first_loop = cp.loop;
+        skip_to = cp.test;
+        exit_code |= cp.exit_code;
+        if (skip_to > ntests) {
+            /* It was saved after the last test of the loop. */
+            first_loop++;
+            skip_to = 0;
+        }
+        LOGD("resuming from %s at loop %lu\n", checkpoint_path, first_loop);
+        sprintf(buffer, "resuming from checkpoint at loop %lu, %s\n",
+                first_loop, skip_to ? table[skip_to - 1].name :
+                "Stuck Address");
+        ev_message(events, buffer);
+    } else if (checkpoint_path && errno != ENOENT) {
+        LOGD("not resuming from %s: %s\n", checkpoint_path, strerror(errno));
+        sprintf(buffer, "not resuming from checkpoint: %s\n",
+                errno == ESRCH ? "it is for another command" :
+                strerror(errno));
+        ev_message(events, buffer);
+    }
+
+    /* Report the seed so a failing run can be replayed with -r. */
+    if (!seed_specified) seed = memtester_seed();
+    engine->seed = seed;
+    cp.seed = seed;
+    LOGD("seed 0x%016llx\n", seed);
+    sprintf(buffer, "seed 0x%016llx\n", seed);
+    ev_message(events, buffer);
+    if (budget_ns) {
+        LOGD("time budget %llu s\n", budget_ns / 1000000000ULL);
+        sprintf(buffer, "time budget %llu s, only tests that fit are run\n",
+                budget_ns / 1000000000ULL);
+        ev_message(events, buffer);
+    }
+
+    simd_init();
+    LOGD("using %s compare, %s fill\n", simd->name,
+            s->use_nt_stores ? "streaming" : "cached");
+    sprintf(buffer, "using %s compare, %s fill\n", simd->name,
+            s->use_nt_stores ? "streaming" : "cached");
+    ev_message(events, buffer);
+    if (s->evict_caches) {
+        cache_init();
+        LOGD("evicting caches before verify: %s\n", cache_evict_method());
+        sprintf(buffer, "evicting caches before verify: %s\n",
+                cache_evict_method());
+        ev_message(events, buffer);
+    }
+    if (single) {
+        LOGD("single-buffer mode, testing %llu bytes\n",
+                (ull) count * sizeof(ul));
+        sprintf(buffer, "single-buffer mode, testing %llu bytes\n",
+                (ull) count * sizeof(ul));
+        ev_message(events, buffer);
+    }
+
+    /* How long the session took to get going, mostly faulting in and
+       locking the region. */
+    LOGD("ready in %llu ms (memory %llu ms)\n",
+            (now_ns() - session_start) / 1000000, alloc_ns / 1000000);
+    sprintf(buffer, "ready in %llu ms (memory %llu ms)\n",
+            (now_ns() - session_start) / 1000000, alloc_ns / 1000000);
+    ev_message(events, buffer);
+    ev_ready(events, nthreads, seed, simd->name, s->use_nt_stores,
+             s->evict_caches ? cache_evict_method() : NULL, single,
+             now_ns() - session_start);
+
+    /* A unit which fails the quick screen is rejected at once. */
+    if (quick && !resumed && quick_screen(s, engine, &fails, reporting ? &progress : NULL,
+                              bufsize)) {
+        LOGD("quick screen FAILED, skipping the full test\n");
+        ev_message(events, "quick screen FAILED, skipping the full test\n");
+        exit_code |= EXIT_FAIL_SCREEN;
+    }
+    report_quarantine(s, "Quick screen", badpages_path, offb, count,
+                      &bp_error);
+
+    /* cancel_point() waits here while the client has paused the session,
+       and ends the loop once it said stop.  With -T the session ends when
+       no test fits in the time left. */
+    for(loop=first_loop; !(exit_code & EXIT_FAIL_SCREEN) &&
+        ((!loops) || loop <= loops) && !cancel_point(&s->cancel) &&
+        (!budget_ns || budget_any_fits(&budget)); loop++) {
+        s->loop = loop;
+        if (reporting) progress_loop(&progress, loop);
+        if (s->physmap) {
+            /* Pages moved: known bad ones may be under other offsets. */
+            ret = physmap_refresh(s->physmap);
+            if (ret < 0) s->physmap = NULL;
+            if (ret > 0 && s->badpages) {
+                badpages_place(&badpages, 0, 0, s->physmap);
+            }
+        }
         LOGD("Loop %lu", loop);
         if (loops) {
             LOGD("/%lu", loops);
             memset(buffer, sizeof(buffer), 0);
             sprintf(buffer, "Loop %lu / %lu\n", loop,  loops);
-            send(client_socket, buffer, strlen(buffer), 0);
+            ev_message(events, buffer);
         }else{
             memset(buffer, sizeof(buffer), 0);
             sprintf(buffer, "Loop %lu\n", loop);
-            send(client_socket, buffer, strlen(buffer), 0);
+            ev_message(events, buffer);
         }
         LOGD(":\n");
-        LOGD("  %-20s: ", "Stuck Address");
-        fflush(stdout);
-        if (!test_stuck_address(aligned, bufsize / sizeof(ul))) {
-             LOGD("ok\n");
-             memset(buffer, sizeof(buffer), 0);
-             sprintf(buffer, "  %-20s: ok!\n", "Stuck Address");
-             send(client_socket, buffer, strlen(buffer), 0);
+        done = 0;
+        if (skip_to > 0) {
+            /* Run before the session was restarted, see -c. */
+        } else if (budget_ns && !budget_fits(&budget, 0)) {
+            report_skipped(events, &budget, 0);
         } else {
-            exit_code |= EXIT_FAIL_ADDRESSLINES;
+            LOGD("  %-20s: ", "Stuck Address");
+            fflush(stdout);
+            s->test = "Stuck Address";
+            ev_test_start(events, "Stuck Address", loop, -1);
+            fail_begin(&fails, "Stuck Address");
+            if (reporting) progress_test(&progress, "Stuck Address");
+            test_start = now_ns();
+            ret = engine_run(engine, run_stuck_address, NULL);
+            test_ns = now_ns() - test_start;
+            if (reporting) progress_test_end(&progress);
+            if (s->cancel.state == CANCEL_STOP) {
+                report_stopped(events, "Stuck Address");
+                break;
+            }
+            if (use_numa) account_nodes(engine, &plan);
+            stats_collect(engine, test_ns, &sample);
+            stats_add(&summary[0], &sample, ret);
+            LOGD("%s\n", ret ? "FAILED" : "ok");
+            ev_test_end(events, "Stuck Address", loop, ret, &sample,
+                        s->evict_caches ? max_evict_ns(engine) : 0);
+            report_failures(s, &fails, bufsize);
+            report_quarantine(s, "Stuck Address", badpages_path, offb, count,
+                              &bp_error);
+            if (budget_ns) budget_done(&budget, 0, test_ns);
+            done = 1;
+            ev_progress(events, loop, loops, done, nenabled);
+            if (ret) {
+                exit_code |= EXIT_FAIL_ADDRESSLINES;
+            }
+            if (checkpoint_path) {
+                cp.loop = loop;
+                cp.test = 1;
+                cp.exit_code = exit_code;
+                save_checkpoint(s, checkpoint_path, &cp, summary, ntests + 1,
+                                &cp_error);
+            }
         }
         for (i=0;;i++) {
-            if (!tests[i].name) break;
+            if (!table[i].name) break;
             /* If using a custom testmask, only run this test if the
                bit corresponding to this test was set by the user.
              */
             if (testmask && (!((1 << i) & testmask))) {
                 continue;
             }
-            LOGD("  %-20s: ", tests[i].name);
-            if (!tests[i].fp(bufa, bufb, count)) {
-                LOGD("ok\n");
-                memset(buffer, sizeof(buffer), 0);
-                sprintf(buffer,"  %-20s: ok!\n", tests[i].name);
-                send(client_socket, buffer, strlen(buffer), 0);
-            } else {
+            if ((int) i + 1 < skip_to) continue;
+            if (cancel_point(&s->cancel)) break;
+            if (budget_ns && !budget_any_fits(&budget)) break;
+            if (budget_ns && !budget_fits(&budget, i + 1)) {
+                report_skipped(events, &budget, i + 1);
+                continue;
+            }
+            s->test = table[i].name;
+            LOGD("  %-20s: ", table[i].name);
+            run.test = &table[i];
+            run.loop = loop;
+            run.index = i;
+            ev_test_start(events, table[i].name, loop, i);
+            fail_begin(&fails, table[i].name);
+            if (reporting) progress_test(&progress, table[i].name);
+            test_start = now_ns();
+            ret = engine_run(engine, job, &run);
+            test_ns = now_ns() - test_start;
+            if (reporting) progress_test_end(&progress);
+            if (s->cancel.state == CANCEL_STOP) {
+                report_stopped(events, table[i].name);
+                break;
+            }
+            if (use_numa) account_nodes(engine, &plan);
+            stats_collect(engine, test_ns, &sample);
+            stats_add(&summary[i + 1], &sample, ret);
+            if (budget_ns) budget_done(&budget, i + 1, test_ns);
+            LOGD("%s\n", ret ? "FAILED" : "ok");
+            ev_test_end(events, table[i].name, loop, ret, &sample,
+                        s->evict_caches ? max_evict_ns(engine) : 0);
+            report_failures(s, &fails, bufsize);
+            report_quarantine(s, table[i].name, badpages_path, offb, count,
+                              &bp_error);
+            ev_progress(events, loop, loops, ++done, nenabled);
+            if (ret) {
                 exit_code |= EXIT_FAIL_OTHERTEST;
             }
+            if (checkpoint_path) {
+                cp.loop = loop;
+                cp.test = i + 2;
+                cp.exit_code = exit_code;
+                save_checkpoint(s, checkpoint_path, &cp, summary, ntests + 1,
+                                &cp_error);
+            }
             fflush(stdout);
         }
+        skip_to = 0;
+        /* Per-node results: region MB tested per second over the loop. */
+        for (i = 0; use_numa && i < (ul) topo.nnodes; i++) {
+            node = &topo.nodes[i];
+            LOGD("  node %d: %s, %llu MB/s\n", node->id,
+                    node->failed ? "FAILED" : "ok",
+                    node->ns ? node->bytes * 1000 / node->ns : 0);
+            sprintf(buffer, "  node %-15d: %s, %llu MB/s\n", node->id,
+                    node->failed ? "FAILED" : "ok",
+                    node->ns ? node->bytes * 1000 / node->ns : 0);
+            ev_message(events, buffer);
+            node->failed = 0;
+            node->bytes = node->ns = 0;
+        }
         LOGD("\n");
         fflush(stdout);
     }
-    if (do_mlock) munlock((void *) aligned, bufsize);
-    LOGD("Done.\n");
-    memset(buffer, sizeof(buffer), 0);
-    sprintf(buffer, "Done.\n");
-    send(client_socket, buffer, strlen(buffer), 0);
+    s->test = NULL;
+    if (s->cancel.state == CANCEL_STOP) {
+        LOGD("stopped.\n");
+        ev_message(events, "stopped.\n");
+    } else if (checkpoint_path) {
+        /* Finished: the next session with this command starts over. */
+        checkpoint_remove(checkpoint_path);
+    }
+    ev_summary(events, summary, ntests + 1);
+    if (budget_ns) ev_coverage(events, &budget);
+
+out:
+    if (reporting) progress_stop(&progress);
+    if (engine) engine_destroy(engine);
+    s->fails = NULL;
+    if (fails.workers) fail_log_free(&fails);
+    s->badpages = NULL;
+    if (badpages.bad) badpages_free(&badpages);
+    s->physmap = NULL;
+    physmap_free(&physmap);
+    if (use_numa) {
+        numa_plan_free(&plan);
+        numa_free(&topo);
+    }
+    /* Keep the locked region for the next session, see alloc_keep(). */
+    if (region.map && do_mlock && !use_numa && !backend) {
+        alloc_keep(&region);
+    } else if (backend) {
+        backend->release(&region);
+    } else {
+        if (region.map && do_mlock) munlock((void *) region.aligned,
+                                            region.bufsize);
+        alloc_release(&region);
+    }
+    free(summary);
+    if (budget.tests) budget_free(&budget);
     fflush(stdout);
-    exit(exit_code);
+    return exit_code;
 }
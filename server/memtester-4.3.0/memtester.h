@@ -15,8 +15,9 @@
 
 #include <sys/types.h>
 
-/* extern declarations. */
-
-extern int use_phys;
-extern off_t physaddrbase;
+#include "session.h"
 
+/* What the tests need to know (use_phys, physaddrbase, test_base, -n, -f
+   and the event stream) used to be globals here.  Sessions run side by
+   side now, so it is kept in struct session; the tests find theirs with
+   session_self(). */
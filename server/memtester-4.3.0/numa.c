@@ -0,0 +1,235 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains NUMA support for -N: the nodes and their CPUs are read
+ * from sysfs, and memory is bound to a node with the mbind() system call.
+ * libnuma is not used since it is not available everywhere memtester runs
+ * (Android in particular).
+ *
+ * The worker threads are spread evenly over the nodes and pinned to CPUs of
+ * their node, and each worker's slice of the region is bound to that node
+ * before it is first touched, so every node's memory is tested from a local
+ * CPU and the results can be reported per node.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "numa.h"
+#include "engine.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+#define MPOL_BIND 2
+#define MASK_LONGS (NUMA_MAX_NODES / (8 * sizeof(unsigned long)))
+
+/* Parse a sysfs list such as "0-3,8,10-11" into flags[0..max). */
+static int parse_list(const char *s, char *flags, int max) {
+    char *end;
+    long a, b;
+
+    memset(flags, 0, max);
+    while (*s && *s != '\n') {
+        a = strtol(s, &end, 10);
+        if (end == s || a < 0) return -1;
+        b = a;
+        s = end;
+        if (*s == '-') {
+            b = strtol(s + 1, &end, 10);
+            if (end == s + 1 || b < a) return -1;
+            s = end;
+        }
+        for (; a <= b && a < max; a++) {
+            flags[a] = 1;
+        }
+        if (*s == ',') s++;
+    }
+    return 0;
+}
+
+static int read_list(const char *path, char *flags, int max) {
+    char line[4096];
+    FILE *f = fopen(path, "r");
+    int r = -1;
+
+    if (!f) return -1;
+    if (fgets(line, sizeof(line), f)) r = parse_list(line, flags, max);
+    fclose(f);
+    return r;
+}
+
+/* Find the nodes that have memory and CPUs we may run on.  Nodes with only
+   memory (no CPUs) are left out: there is no local CPU to test them from.
+   Returns 0 if at least one node was found. */
+int numa_discover(struct numa_topology *t) {
+    char nodes[NUMA_MAX_NODES], cpus[CPU_SETSIZE], path[128];
+    cpu_set_t allowed;
+    struct numa_node *n;
+    int node, cpu;
+
+    memset(t, 0, sizeof(*t));
+    if (read_list(NODE_DIR "/has_memory", nodes, NUMA_MAX_NODES) < 0 &&
+        read_list(NODE_DIR "/online", nodes, NUMA_MAX_NODES) < 0) {
+        return -1;
+    }
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) return -1;
+    t->nodes = (struct numa_node *) calloc(NUMA_MAX_NODES, sizeof(*t->nodes));
+    if (!t->nodes) return -1;
+
+    for (node = 0; node < NUMA_MAX_NODES; node++) {
+        if (!nodes[node]) continue;
+        snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+        if (read_list(path, cpus, CPU_SETSIZE) < 0) continue;
+        n = &t->nodes[t->nnodes];
+        n->cpus = (int *) malloc(CPU_SETSIZE * sizeof(int));
+        if (!n->cpus) break;
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (cpus[cpu] && CPU_ISSET(cpu, &allowed)) {
+                n->cpus[n->ncpus++] = cpu;
+            }
+        }
+        if (!n->ncpus) {
+            free(n->cpus);
+            n->cpus = NULL;
+            continue;
+        }
+        n->id = node;
+        t->nnodes++;
+    }
+    if (!t->nnodes) {
+        numa_free(t);
+        return -1;
+    }
+    return 0;
+}
+
+void numa_free(struct numa_topology *t) {
+    int i;
+
+    if (!t->nodes) return;
+    for (i = 0; i < t->nnodes; i++) {
+        free(t->nodes[i].cpus);
+    }
+    free(t->nodes);
+    t->nodes = NULL;
+    t->nnodes = 0;
+}
+
+/* Place [p, p + len) on node.  Must be called before the pages are first
+   touched; p must be page aligned. */
+int numa_bind(void volatile *p, size_t len, int node) {
+#ifdef SYS_mbind
+    unsigned long mask[MASK_LONGS];
+
+    if (node < 0 || node >= NUMA_MAX_NODES) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    /* The kernel takes one more than the number of bits in the mask. */
+    return (int) syscall(SYS_mbind, (void *) p, len, MPOL_BIND, mask,
+                         NUMA_MAX_NODES + 1, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Spread nthreads workers over the nodes, in node order so that each
+   node's slices are contiguous; 0 means one worker per CPU.  Every node
+   gets at least one worker.  Returns the number of workers, or -1. */
+int numa_plan_create(struct numa_plan *plan, struct numa_topology *t,
+                     int nthreads) {
+    struct numa_node *n;
+    int i, k, first;
+
+    memset(plan, 0, sizeof(*plan));
+    if (!nthreads) {
+        for (k = 0; k < t->nnodes; k++) {
+            nthreads += t->nodes[k].ncpus;
+        }
+    }
+    if (nthreads < t->nnodes) nthreads = t->nnodes;
+    plan->node = (int *) malloc(nthreads * sizeof(int));
+    plan->cpu = (int *) malloc(nthreads * sizeof(int));
+    if (!plan->node || !plan->cpu) {
+        numa_plan_free(plan);
+        return -1;
+    }
+    for (k = 0; k < t->nnodes; k++) {
+        n = &t->nodes[k];
+        first = (int) ((long long) nthreads * k / t->nnodes);
+        for (i = first; i < (long long) nthreads * (k + 1) / t->nnodes; i++) {
+            plan->node[i] = k;
+            plan->cpu[i] = n->cpus[(i - first) % n->ncpus];
+        }
+    }
+    plan->topo = t;
+    plan->nthreads = nthreads;
+    return nthreads;
+}
+
+void numa_plan_free(struct numa_plan *plan) {
+    free(plan->node);
+    free(plan->cpu);
+    plan->node = plan->cpu = NULL;
+}
+
+/* Bind bytes [from, to) of the buffer at base to node, widened to whole
+   pages of the region.  A page shared by two slices goes to the first. */
+static int bind_range(char volatile *base, size_t from, size_t to,
+                      size_t limit, size_t pagesize, int node) {
+    from = (from + pagesize - 1) & ~(pagesize - 1);
+    to = (to + pagesize - 1) & ~(pagesize - 1);
+    if (to > limit) to = limit;
+    if (to <= from) return 0;
+    return numa_bind(base + from, to - from, node);
+}
+
+/* alloc_bind_fn for -N: lay the fresh mapping [p, p + len) out the way
+   do_memory_test() and engine_create() will, and bind each worker's slice
+   of bufa (and bufb) to the worker's node. */
+int numa_bind_slices(void volatile *p, size_t len, void *arg) {
+    struct numa_plan *plan = (struct numa_plan *) arg;
+    char volatile *base = (char volatile *) p;
+    size_t half, count, start, end, sz = sizeof(unsigned long);
+    int i, node, last;
+
+    half = plan->single ? len : len / 2;
+    count = half / sz;
+    for (i = 0; i < plan->nthreads; i++) {
+        engine_slice(count, plan->nthreads, plan->align, i, &start, &end);
+        node = plan->topo->nodes[plan->node[i]].id;
+        /* The last slice also takes the bytes past the last whole word. */
+        last = (i == plan->nthreads - 1);
+        if (bind_range(base, start * sz, last ? half : end * sz, len,
+                       plan->pagesize, node) < 0) {
+            return -1;
+        }
+        if (!plan->single &&
+            bind_range(base, half + start * sz, last ? len : half + end * sz,
+                       len, plan->pagesize, node) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for NUMA node discovery and memory
+ * placement.  See numa.c.
+ *
+ */
+
+#ifndef MEMTESTER_NUMA_H
+#define MEMTESTER_NUMA_H
+
+#include <sys/types.h>
+
+#define NUMA_MAX_NODES 1024
+
+struct numa_node {
+    int id;                             /* node number in sysfs */
+    int ncpus;
+    int *cpus;                          /* its CPUs we may run on */
+    /* Per-loop results, see account_nodes() in memtester.c. */
+    int failed;
+    unsigned long long bytes;           /* region bytes tested */
+    unsigned long long ns;              /* time its slowest worker took */
+};
+
+struct numa_topology {
+    int nnodes;
+    struct numa_node *nodes;
+};
+
+/* Which node and CPU each worker gets, and how the region is laid out, so
+   numa_bind_slices() can place each worker's slice on its node. */
+struct numa_plan {
+    struct numa_topology *topo;
+    int nthreads;
+    int *node;                          /* index into topo->nodes */
+    int *cpu;                           /* CPU to pin to */
+    int single;                         /* one buffer rather than two halves */
+    size_t align;                       /* slice alignment in words */
+    size_t pagesize;                    /* of the pages backing the region */
+};
+
+/* Function declarations. */
+
+int numa_discover(struct numa_topology *t);
+void numa_free(struct numa_topology *t);
+int numa_bind(void volatile *p, size_t len, int node);
+int numa_plan_create(struct numa_plan *plan, struct numa_topology *t,
+                     int nthreads);
+void numa_plan_free(struct numa_plan *plan);
+int numa_bind_slices(void volatile *p, size_t len, void *arg);
+
+#endif /* MEMTESTER_NUMA_H */
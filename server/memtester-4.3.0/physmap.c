@@ -0,0 +1,184 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the physical address table of the tested region.
+ * Without -p a failure is only an offset into our own mapping, which says
+ * nothing about the DIMM, rank or page that is bad.  Once the region is
+ * locked, /proc/self/pagemap gives the page frame of every page; runs of
+ * physically contiguous pages are kept as one entry (a huge page is always
+ * one), so the table is small and a failure is translated by a binary
+ * search, without a system call.
+ *
+ * Locked pages can still be moved by the kernel, by compaction or NUMA
+ * balancing, and small pages be collapsed into a transparent huge page.
+ * These are counted in pgmigrate_success and thp_collapse_alloc in
+ * /proc/vmstat, so physmap_refresh() reads the table again only when one
+ * of those has changed.
+ *
+ * The page frames read as 0 without CAP_SYS_ADMIN; there is no table then.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "physmap.h"
+
+#define PAGEMAP_PRESENT     (1ULL << 63)
+#define PAGEMAP_PFN_MASK    ((1ULL << 55) - 1)
+#define PAGEMAP_BATCH       4096        /* entries read at once */
+
+/* Pages migrated or collapsed since boot, or 0 if the kernel does not
+   say. */
+static unsigned long long migrations(void) {
+    char line[128];
+    unsigned long long n, sum = 0;
+    FILE *f = fopen("/proc/vmstat", "r");
+
+    if (!f) return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "pgmigrate_success %llu", &n) == 1 ||
+            sscanf(line, "thp_collapse_alloc %llu", &n) == 1) {
+            sum += n;
+        }
+    }
+    fclose(f);
+    return sum;
+}
+
+static int add_run(struct physmap *m, size_t offset, size_t len,
+                   unsigned long long phys) {
+    struct physmap_run *r;
+
+    if (m->nruns) {
+        r = &m->runs[m->nruns - 1];
+        if (r->offset + r->len == offset && r->phys + r->len == phys) {
+            r->len += len;
+            return 0;
+        }
+    }
+    if (m->nruns == m->size) {
+        r = (struct physmap_run *) realloc(m->runs, (m->size ? m->size * 2 :
+                                           64) * sizeof(*r));
+        if (!r) return -1;
+        m->runs = r;
+        m->size = m->size ? m->size * 2 : 64;
+    }
+    r = &m->runs[m->nruns++];
+    r->offset = offset;
+    r->len = len;
+    r->phys = phys;
+    return 0;
+}
+
+/* Read the table of len bytes at base, which must be page aligned and
+   locked; returns -1 with errno set, EPERM if the page frames are hidden
+   from us. */
+int physmap_build(struct physmap *m, void volatile *base, size_t len) {
+    uint64_t entries[PAGEMAP_BATCH];
+    size_t page = (size_t) sysconf(_SC_PAGESIZE), first, npages, i, n, off;
+    ssize_t got;
+    int fd, err = 0;
+
+    m->base = base;
+    m->len = len;
+    m->nruns = 0;
+    m->migrations = migrations();
+    fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) return -1;
+    first = (size_t) base / page;
+    npages = (len + page - 1) / page;
+    for (i = 0; i < npages && !err; i += n) {
+        n = npages - i < PAGEMAP_BATCH ? npages - i : PAGEMAP_BATCH;
+        got = pread(fd, entries, n * sizeof(entries[0]),
+                    (off_t) (first + i) * sizeof(entries[0]));
+        if (got < (ssize_t) sizeof(entries[0])) {
+            err = got < 0 ? errno : EIO;
+            break;
+        }
+        n = (size_t) got / sizeof(entries[0]);
+        for (off = 0; off < n; off++) {
+            if (!(entries[off] & PAGEMAP_PRESENT)) continue;
+            if (!(entries[off] & PAGEMAP_PFN_MASK)) {
+                err = EPERM;
+                break;
+            }
+            if (add_run(m, (i + off) * page, page,
+                        (entries[off] & PAGEMAP_PFN_MASK) *
+                        (unsigned long long) page) < 0) {
+                err = ENOMEM;
+                break;
+            }
+        }
+    }
+    close(fd);
+    if (err) {
+        m->nruns = 0;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* Read the table again if pages have been migrated since it was read;
+   returns 1 if it was, -1 if that failed (the table is then empty). */
+int physmap_refresh(struct physmap *m) {
+    if (migrations() == m->migrations) return 0;
+    return physmap_build(m, m->base, m->len) < 0 ? -1 : 1;
+}
+
+/* The physical address of the byte at offset; -1 if it is not known. */
+int physmap_lookup(const struct physmap *m, size_t offset,
+                   unsigned long long *phys) {
+    int lo = 0, hi = m->nruns - 1, mid;
+    const struct physmap_run *r;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        r = &m->runs[mid];
+        if (offset < r->offset) {
+            hi = mid - 1;
+        } else if (offset >= r->offset + r->len) {
+            lo = mid + 1;
+        } else {
+            *phys = r->phys + (offset - r->offset);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Where the physical address phys is in the region; -1 if it is not. */
+int physmap_offset(const struct physmap *m, unsigned long long phys,
+                   size_t *offset) {
+    const struct physmap_run *r;
+    int i;
+
+    for (i = 0; i < m->nruns; i++) {
+        r = &m->runs[i];
+        if (phys >= r->phys && phys - r->phys < r->len) {
+            *offset = r->offset + (size_t) (phys - r->phys);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void physmap_free(struct physmap *m) {
+    free(m->runs);
+    m->runs = NULL;
+    m->nruns = m->size = 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the physical address table of
+ * the tested region, read from /proc/self/pagemap.  See physmap.c.
+ *
+ */
+
+#ifndef MEMTESTER_PHYSMAP_H
+#define MEMTESTER_PHYSMAP_H
+
+#include <sys/types.h>
+
+/* len bytes from offset of the region are physically contiguous. */
+struct physmap_run {
+    size_t offset;
+    size_t len;
+    unsigned long long phys;
+};
+
+struct physmap {
+    void volatile *base;
+    size_t len;
+    int nruns;
+    int size;                           /* runs allocated */
+    struct physmap_run *runs;           /* by offset */
+    unsigned long long migrations;      /* migrations when read */
+};
+
+/* Function declarations. */
+
+int physmap_build(struct physmap *m, void volatile *base, size_t len);
+int physmap_refresh(struct physmap *m);
+int physmap_lookup(const struct physmap *m, size_t offset,
+                   unsigned long long *phys);
+int physmap_offset(const struct physmap *m, unsigned long long phys,
+                   size_t *offset);
+void physmap_free(struct physmap *m);
+
+#endif /* MEMTESTER_PHYSMAP_H */
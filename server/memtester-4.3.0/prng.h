@@ -0,0 +1,67 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the pseudo-random number generator used by the tests:
+ * xoshiro256** (Blackman and Vigna), seeded through splitmix64.  Each worker
+ * thread owns its own state, so generating test data needs no locking and a
+ * run can be replayed exactly from its seed.
+ *
+ */
+
+#ifndef MEMTESTER_PRNG_H
+#define MEMTESTER_PRNG_H
+
+#include <stdint.h>
+
+struct prng {
+    uint64_t s[4];
+};
+
+static inline uint64_t prng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/* Advance *x and return the next splitmix64 output. */
+static inline uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline void prng_seed(struct prng *r, uint64_t seed) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        r->s[i] = splitmix64(&seed);
+    }
+}
+
+static inline uint64_t prng_next(struct prng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+    return result;
+}
+
+/* One random word; the high bits are the better ones. */
+static inline unsigned long prng_ul(struct prng *r) {
+    return (unsigned long) (prng_next(r) >> (64 - 8 * sizeof(unsigned long)));
+}
+
+#endif /* MEMTESTER_PRNG_H */
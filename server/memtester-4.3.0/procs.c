@@ -0,0 +1,309 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the multi-process mode of -P.  One process can only
+ * map and lock so much: under 3 GB of address space on a 32-bit build, and
+ * no more than RLIMIT_MEMLOCK.  With -P N the session tests nothing itself
+ * but starts N processes, each of which runs the same command on its share
+ * of the memory, and passes on what they send to its client: lines with a
+ * "[i] " prefix, frames with a "proc" field.  A -p list of several
+ * physical ranges is tested the same way, one process per range, so the
+ * ranges are tested in parallel.  Each process has a socket of
+ * its own to the session, on which it gets the client's pause, resume and
+ * stop.  The session's exit code is that of all processes together.
+ *
+ * The daemon runs other sessions on other threads, so a process is started
+ * with vfork() and execs the daemon again (PROCS_CHILD), which then runs
+ * the one session with session_run() rather than listening for clients.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE                     /* vfork() */
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "procs.h"
+#include "events.h"
+#include "engine.h"
+#include "cancel.h"
+
+#define FRAME_HDR       8               /* 'M' 'T' version type length */
+#define RELAY_MAX       (1024 * 1024)   /* longest line or frame passed on */
+#define POLL_MS         100
+
+#ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+#endif
+
+/* One process of the session and what it sent that is not passed on yet. */
+struct proc {
+    pid_t pid;
+    int fd;                             /* -1 once it hung up */
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+/* Split total bytes into nprocs equal shares of whole pages; returns -1
+   if they would be empty or larger than one process can map. */
+int procs_split(struct procs_share *shares, int nprocs,
+                unsigned long long total, size_t pagesize) {
+    unsigned long long share;
+    int i;
+
+    share = (total / nprocs) & ~((unsigned long long) pagesize - 1);
+    if (share < pagesize || share > (size_t) -1) return -1;
+    for (i = 0; i < nprocs; i++) {
+        shares[i].phys = 0;
+        shares[i].bytes = share;
+    }
+    return 0;
+}
+
+/* The command of process i: the session's without -P, with its share of
+   the memory (and with use_phys its own range of -p) instead of the total,
+   threads workers unless that is 0, and FILE.i for the files of -c and -b,
+   which can not be shared.  Returns -1 if it does not fit in size. */
+static int child_cmd(struct session *s, int argi, int i,
+                     const struct procs_share *share, int use_phys,
+                     int threads, char *out, size_t size) {
+    const char *a;
+    size_t n;
+    int k;
+
+    n = snprintf(out, size, "%s", s->argv[0]);
+    if (threads && n < size) {
+        n += snprintf(out + n, size - n, " -t %d", threads);
+    }
+    for (k = 1; k < s->argc && n < size; k++) {
+        a = s->argv[k];
+        if (k == argi) {
+            n += snprintf(out + n, size - n, " %lluB", share->bytes);
+        } else if (use_phys && !strncmp(a, "-p", 2)) {
+            if (!a[2]) k++;
+            n += snprintf(out + n, size - n, " -p 0x%llx", share->phys);
+        } else if (!strncmp(a, "-P", 2)) {
+            if (!a[2]) k++;
+        } else if ((!strcmp(a, "-c") || !strcmp(a, "-b")) &&
+                   k + 1 < s->argc) {
+            n += snprintf(out + n, size - n, " %s %s.%d", a, s->argv[k + 1],
+                          i);
+            k++;
+        } else if (!strncmp(a, "-c", 2) || !strncmp(a, "-b", 2)) {
+            n += snprintf(out + n, size - n, " %s.%d", a, i);
+        } else {
+            n += snprintf(out + n, size - n, " %s", a);
+        }
+    }
+    return n < size ? 0 : -1;
+}
+
+/* Start a process for cmd with fd as its socket.  Between vfork() and
+   exec it only moves its socket into place and closes the rest. */
+static pid_t spawn(const char *cmd, int fd, int maxfd) {
+    pid_t pid;
+    int i;
+
+    pid = vfork();
+    if (pid) return pid;
+    if (fd != PROCS_FD && dup2(fd, PROCS_FD) < 0) _exit(127);
+    for (i = PROCS_FD + 1; i < maxfd; i++) close(i);
+    execl("/proc/self/exe", "memtester", PROCS_CHILD, cmd, (char *) NULL);
+    _exit(127);
+}
+
+/* Pass on the complete lines or frames process i has sent, and with last
+   whatever is left; but not its "done", the session sends its own. */
+static void relay(struct event_sink *events, struct proc *p, int i,
+                  int last) {
+    unsigned char *h;
+    size_t used = 0, len;
+    char *end, save;
+
+    if (events->mode == EVENTS_LINES) {
+        while (used < p->len) {
+            end = (char *) memchr(p->buf + used, '\n', p->len - used);
+            if (!end && !last) break;
+            len = end ? (size_t) (end + 1 - (p->buf + used)) : p->len - used;
+            save = p->buf[used + len];
+            p->buf[used + len] = '\0';
+            if (strcmp(p->buf + used, "Done.\n")) {
+                ev_relay(events, i, EV_MESSAGE, p->buf + used);
+            }
+            p->buf[used + len] = save;
+            used += len;
+        }
+    } else {
+        while (p->len - used >= FRAME_HDR) {
+            h = (unsigned char *) p->buf + used;
+            if (h[0] != 'M' || h[1] != 'T') {
+                /* Out of step; drop the rest. */
+                used = p->len;
+                break;
+            }
+            len = ((size_t) h[4] << 24) | ((size_t) h[5] << 16) |
+                  ((size_t) h[6] << 8) | h[7];
+            if (p->len - used - FRAME_HDR < len) break;
+            save = p->buf[used + FRAME_HDR + len];
+            p->buf[used + FRAME_HDR + len] = '\0';
+            if (h[3] != EV_DONE) {
+                ev_relay(events, i, h[3], p->buf + used + FRAME_HDR);
+            }
+            p->buf[used + FRAME_HDR + len] = save;
+            used += FRAME_HDR + len;
+        }
+    }
+    memmove(p->buf, p->buf + used, p->len - used);
+    p->len -= used;
+}
+
+/* Read what process i sent; returns 0 once it has hung up. */
+static int receive(struct event_sink *events, struct proc *p, int i) {
+    char *buf;
+    ssize_t n;
+
+    if (p->len == p->size) {
+        if (p->size >= RELAY_MAX) {
+            /* A line or frame too long to pass on. */
+            p->len = 0;
+        } else {
+            buf = (char *) realloc(p->buf, (p->size ? p->size * 2 : 4096) +
+                                   1);
+            if (!buf) return 0;
+            p->buf = buf;
+            p->size = p->size ? p->size * 2 : 4096;
+        }
+    }
+    n = read(p->fd, p->buf + p->len, p->size - p->len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return 1;
+    if (n <= 0) {
+        relay(events, p, i, 1);
+        return 0;
+    }
+    p->len += (size_t) n;
+    relay(events, p, i, 0);
+    return 1;
+}
+
+/* Run the session's command as nprocs processes, process i on shares[i]
+   (with use_phys, on that physical range); argi is the memory argument in
+   s->argv and nthreads the workers of -t, or 0.  The exit codes of the
+   processes are or-ed into *exit_code; returns how many of them did not
+   run to the end. */
+int procs_run(struct session *s, int nprocs, int argi,
+              const struct procs_share *shares, int use_phys, int nthreads,
+              int *exit_code) {
+    static const char *controls[] = { "resume\n", "pause\n", "stop\n" };
+    struct event_sink *events = s->events;
+    struct proc procs[PROCS_MAX];
+    struct pollfd fds[PROCS_MAX];
+    int which[PROCS_MAX];
+    char cmd[SESSION_CMDLEN], buffer[SESSION_CMDLEN + 64];
+    int i, nfds, sv[2], running = 0, lost = 0, state = CANCEL_RUN, status;
+    long maxfd;
+
+    /* The CPUs are shared out like the memory. */
+    if (!nthreads) {
+        nthreads = engine_online_cpus() / nprocs;
+        if (nthreads < 1) nthreads = 1;
+    }
+    sprintf(buffer, "using %d processes, %d threads each\n", nprocs,
+            nthreads);
+    ev_message(events, buffer);
+    maxfd = sysconf(_SC_OPEN_MAX);
+    if (maxfd < 0 || maxfd > 65536) maxfd = 65536;
+
+    memset(procs, 0, sizeof(procs));
+    for (i = 0; i < nprocs; i++) {
+        procs[i].fd = -1;
+        if (child_cmd(s, argi, i, &shares[i], use_phys, nthreads, cmd,
+                      sizeof(cmd)) < 0) {
+            errno = E2BIG;
+        } else if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0) {
+            procs[i].pid = spawn(cmd, sv[1], (int) maxfd);
+            close(sv[1]);
+            if (procs[i].pid > 0) {
+                procs[i].fd = sv[0];
+                running++;
+                snprintf(buffer, sizeof(buffer), "process %d: %s\n", i, cmd);
+                ev_message(events, buffer);
+                continue;
+            }
+            close(sv[0]);
+        }
+        lost++;
+        sprintf(buffer, "failed to start process %d: %s\n", i,
+                strerror(errno));
+        ev_message(events, buffer);
+    }
+
+    /* Until the last one hangs up; the client's pause, resume and stop are
+       passed on as they come. */
+    while (running) {
+        if (s->cancel.state != state) {
+            state = s->cancel.state;
+            for (i = 0; i < nprocs; i++) {
+                if (procs[i].fd < 0) continue;
+                send(procs[i].fd, controls[state], strlen(controls[state]),
+                     MSG_NOSIGNAL);
+            }
+        }
+        for (i = nfds = 0; i < nprocs; i++) {
+            if (procs[i].fd < 0) continue;
+            fds[nfds].fd = procs[i].fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            which[nfds++] = i;
+        }
+        if (poll(fds, nfds, POLL_MS) < 0 && errno != EINTR) break;
+        for (i = 0; i < nfds; i++) {
+            if (!fds[i].revents) continue;
+            if (!receive(events, &procs[which[i]], which[i])) {
+                close(procs[which[i]].fd);
+                procs[which[i]].fd = -1;
+                running--;
+            }
+        }
+    }
+
+    for (i = 0; i < nprocs; i++) {
+        /* Hanging up stops a process that is still running. */
+        if (procs[i].fd >= 0) close(procs[i].fd);
+        free(procs[i].buf);
+        if (procs[i].pid <= 0) continue;
+        status = -1;
+        while (waitpid(procs[i].pid, &status, 0) < 0 && errno == EINTR);
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 127) {
+            *exit_code |= WEXITSTATUS(status);
+            sprintf(buffer, "process %d: exit code 0x%02x\n", i,
+                    WEXITSTATUS(status));
+        } else {
+            lost++;
+            if (WIFSIGNALED(status)) {
+                sprintf(buffer, "process %d: killed by signal %d\n", i,
+                        WTERMSIG(status));
+            } else {
+                sprintf(buffer, "process %d: failed to start\n", i);
+            }
+        }
+        ev_message(events, buffer);
+    }
+    return lost;
+}
@@ -0,0 +1,41 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for -P, which splits a session over
+ * several processes.  See procs.c.
+ *
+ */
+
+#ifndef MEMTESTER_PROCS_H
+#define MEMTESTER_PROCS_H
+
+#include <sys/types.h>
+
+#include "session.h"
+
+#define PROCS_MAX       16              /* processes of one session */
+#define PROCS_CHILD     "--process"     /* argv[1] of such a process */
+#define PROCS_FD        3               /* its socket to the coordinator */
+
+/* What one process tests: bytes, from phys with -p. */
+struct procs_share {
+    unsigned long long phys;
+    unsigned long long bytes;
+};
+
+/* Function declarations. */
+
+int procs_split(struct procs_share *shares, int nprocs,
+                unsigned long long total, size_t pagesize);
+int procs_run(struct session *s, int nprocs, int argi,
+              const struct procs_share *shares, int use_phys, int nthreads,
+              int *exit_code);
+
+#endif /* MEMTESTER_PROCS_H */
@@ -0,0 +1,142 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the progress reporter.  The test kernels used to draw
+ * a spinner and "setting/testing n" counters on stdout, which cost a few
+ * write() calls per pass on a service whose stdout goes nowhere.  Now each
+ * worker only stores how many words it has gone over (work_done) and how
+ * many the test will take (work_total), see tests.c; one thread per session
+ * reads those every PROGRESS_MS and sends the test's percentage and the
+ * estimated time left, for the test and for the loop, as a test-progress
+ * event.  Tests shorter than that are never reported.
+ *
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "progress.h"
+#include "timing.h"
+
+/* Percent done and the estimated time left of the running test, from the
+   workers' counters; -1 if they have not planned their work yet. */
+static int sample(struct progress *p, unsigned long long elapsed,
+                  unsigned long long *eta_ns) {
+    struct worker *w;
+    unsigned long long done = 0, total = 0;
+    int i;
+
+    for (i = 0; i < p->engine->nthreads; i++) {
+        w = &p->engine->workers[i];
+        done += __atomic_load_n(&w->work_done, __ATOMIC_RELAXED);
+        total += __atomic_load_n(&w->work_total, __ATOMIC_RELAXED);
+    }
+    if (!total) return -1;
+    if (done > total) done = total;
+    /* The workers go at a steady rate, so the rest takes as long again as
+       what is done, in proportion. */
+    *eta_ns = done ? (unsigned long long)
+        ((double) elapsed * (double) (total - done) / (double) done) : 0;
+    return (int) (done * 100 / total);
+}
+
+static void *reporter_main(void *arg) {
+    struct progress *p = (struct progress *) arg;
+    struct timespec until;
+    unsigned long long now, eta_ns, loop_eta_ns;
+    int percent;
+
+    pthread_mutex_lock(&p->lock);
+    while (p->running) {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += PROGRESS_MS / 1000;
+        until.tv_nsec += (PROGRESS_MS % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&p->wake, &p->lock, &until);
+        now = now_ns();
+        if (!p->running || !p->test ||
+            now - p->test_start_ns < PROGRESS_MS * 1000000ULL) {
+            continue;
+        }
+        percent = sample(p, now - p->test_start_ns, &eta_ns);
+        if (percent < 0) continue;
+        /* The last loop is the best guess for this one. */
+        loop_eta_ns = 0;
+        if (p->last_loop_ns > now - p->loop_start_ns) {
+            loop_eta_ns = p->last_loop_ns - (now - p->loop_start_ns);
+        }
+        ev_test_progress(p->events, p->test, p->loop, percent, eta_ns,
+                         p->last_loop_ns ? (long long) loop_eta_ns : -1);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+int progress_start(struct progress *p, struct engine *e,
+                   struct event_sink *events) {
+    memset(p, 0, sizeof(*p));
+    p->engine = e;
+    p->events = events;
+    p->running = 1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    if (pthread_create(&p->thread, NULL, reporter_main, p)) {
+        p->running = 0;
+        pthread_cond_destroy(&p->wake);
+        pthread_mutex_destroy(&p->lock);
+        return -1;
+    }
+    return 0;
+}
+
+/* Stop the reporter; before the engine it reads from goes away. */
+void progress_stop(struct progress *p) {
+    pthread_mutex_lock(&p->lock);
+    if (!p->running) {
+        pthread_mutex_unlock(&p->lock);
+        return;
+    }
+    p->running = 0;
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+}
+
+/* A loop begins; the previous one, if any, ran to its end. */
+void progress_loop(struct progress *p, unsigned long loop) {
+    unsigned long long now = now_ns();
+
+    pthread_mutex_lock(&p->lock);
+    if (p->loop_start_ns) p->last_loop_ns = now - p->loop_start_ns;
+    p->loop = loop;
+    p->loop_start_ns = now;
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* A test is about to be handed to the workers. */
+void progress_test(struct progress *p, const char *test) {
+    pthread_mutex_lock(&p->lock);
+    p->test = test;
+    p->test_start_ns = now_ns();
+    pthread_mutex_unlock(&p->lock);
+}
+
+void progress_test_end(struct progress *p) {
+    pthread_mutex_lock(&p->lock);
+    p->test = NULL;
+    pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,49 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the progress reporter, which
+ * samples the workers' counters while a test runs.  See progress.c.
+ *
+ */
+
+#ifndef MEMTESTER_PROGRESS_H
+#define MEMTESTER_PROGRESS_H
+
+#include <pthread.h>
+
+#include "engine.h"
+#include "events.h"
+
+#define PROGRESS_MS     1000            /* how often a test's progress is sent */
+
+struct progress {
+    struct engine *engine;
+    struct event_sink *events;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    const char *test;                   /* NULL between tests */
+    unsigned long loop;
+    unsigned long long test_start_ns;
+    unsigned long long loop_start_ns;
+    unsigned long long last_loop_ns;    /* 0 until a loop has finished */
+};
+
+/* Function declarations. */
+
+int progress_start(struct progress *p, struct engine *e,
+                   struct event_sink *events);
+void progress_stop(struct progress *p);
+void progress_loop(struct progress *p, unsigned long loop);
+void progress_test(struct progress *p, const char *test);
+void progress_test_end(struct progress *p);
+
+#endif /* MEMTESTER_PROGRESS_H */
@@ -0,0 +1,383 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the session manager.  One thread waits in epoll on the
+ * listening socket, on every client and on a pipe the sessions write to
+ * when they finish.  A client's first message is its command; the session
+ * then runs on a thread of its own, with its own region and worker pool,
+ * while the manager goes on accepting other clients.  Anything a client
+ * sends afterwards is read here: "pause", "resume" and "stop" (or hanging
+ * up) are passed to its session through its cancellation token.  The
+ * command "status" lists the sessions instead of starting one, and
+ * "release" frees the region kept from the last session.
+ *
+ * A process started by -P runs one session with session_run() instead,
+ * for the coordinating session on the other end of its socket.
+ *
+ * The session list is only touched by the manager thread.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "engine.h"
+#include "alloc.h"
+#include "session.h"
+
+#define MAX_EVENTS 16
+#define RETRY_MS   1000                 /* accept() again, out of fds */
+
+#ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+#endif
+
+static pthread_key_t session_key;
+static pthread_once_t session_key_once = PTHREAD_ONCE_INIT;
+
+static struct session *sessions;        /* newest first */
+static int next_id = 1;
+static int done_pipe[2] = { -1, -1 };
+static session_fn run_session;
+
+/* Tags for the epoll data of the two fds which are not clients. */
+static char listen_tag, done_tag;
+static int paused_fd = -1;              /* listen fd, while out of fds */
+
+static void make_session_key(void) {
+    pthread_key_create(&session_key, NULL);
+}
+
+/* The session the calling thread works for: its test thread or one of its
+   workers.  NULL on the manager thread. */
+struct session *session_self(void) {
+    struct worker *w = worker_self();
+
+    if (w) return (struct session *) w->engine->ctx;
+    pthread_once(&session_key_once, make_session_key);
+    return (struct session *) pthread_getspecific(session_key);
+}
+
+/* Split the command at spaces into argv; returns the number of words. */
+static int cmd_split(char **arg, char *params) {
+    int num = 0;
+    char *word = params;
+
+    if ((params == NULL) || (*params == '\0')) {
+        return 0;
+    }
+    arg[num] = params;
+    for (word = params; *word != '\0'; ++word) {
+        if (*word == ' ') {
+            *word = '\0';
+            if ((*(word + 1) != ' ') && (*(word + 1) != '\0') &&
+                (num < SESSION_MAX_ARGS - 1)) {
+                num++;
+                arg[num] = (word + 1);
+            }
+        }
+    }
+    return (num + 1);
+}
+
+static void *session_main(void *arg) {
+    struct session *s = (struct session *) arg;
+
+    pthread_once(&session_key_once, make_session_key);
+    pthread_setspecific(session_key, s);
+    s->exit_code = run_session(s);
+    /* Hand it back to the manager to join and free. */
+    while (write(done_pipe[1], &s, sizeof(s)) < 0 && errno == EINTR);
+    return NULL;
+}
+
+/* Out of descriptors: the listen fd stays readable, so stop watching it
+   until one is closed (or RETRY_MS have passed) instead of spinning. */
+static void listen_pause(int ep, int listen_fd) {
+    if (epoll_ctl(ep, EPOLL_CTL_DEL, listen_fd, NULL) == 0) {
+        paused_fd = listen_fd;
+    }
+}
+
+static void listen_resume(int ep) {
+    struct epoll_event ev;
+
+    if (paused_fd < 0) return;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listen_tag;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, paused_fd, &ev) == 0) paused_fd = -1;
+}
+
+static void session_free(int ep, struct session *s) {
+    struct session **pp;
+
+    for (pp = &sessions; *pp; pp = &(*pp)->next) {
+        if (*pp == s) {
+            *pp = s->next;
+            break;
+        }
+    }
+    epoll_ctl(ep, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    cancel_destroy(&s->cancel);
+    free(s);
+    listen_resume(ep);
+}
+
+static void send_status(struct session *client) {
+    static const char *states[] = { "waiting", "running", "done" };
+    char line[SESSION_CMDLEN + 128];
+    struct session *s;
+    const char *test;
+    size_t kept;
+    int n = 0;
+
+    for (s = sessions; s; s = s->next) {
+        if (s == client || s->state == SESSION_COMMAND) continue;
+        test = s->test;
+        snprintf(line, sizeof(line), "session %d: %s (%s), loop %lu%s%s, %s\n",
+                 s->id, states[s->state], cancel_state_name(s->cancel.state),
+                 s->loop, test ? ", " : "", test ? test : "", s->cmd);
+        send(client->fd, line, strlen(line), MSG_NOSIGNAL);
+        n++;
+    }
+    if (!n) send(client->fd, "no sessions\n", 12, MSG_NOSIGNAL);
+    if ((kept = alloc_kept())) {
+        snprintf(line, sizeof(line), "keeping %lluMB locked for the next "
+                 "session\n", (unsigned long long) kept >> 20);
+        send(client->fd, line, strlen(line), MSG_NOSIGNAL);
+    }
+}
+
+/* True if buff is the word cmd, with or without a newline. */
+static int is_cmd(const char *buff, const char *cmd) {
+    size_t n = strlen(cmd);
+
+    return !strncmp(buff, cmd, n) && (!buff[n] || !strcmp(buff + n, "\n"));
+}
+
+/* What the client of a running session sent, n bytes of buff or the
+   result of a failed read: "pause", "resume" or "stop".  Returns 1 once
+   it said stop or went away; nothing more is read from it then. */
+static int session_control(struct session *s, const char *buff, ssize_t n) {
+    if (n <= 0 || is_cmd(buff, "stop")) {
+        cancel_set(&s->cancel, CANCEL_STOP);
+        return 1;
+    } else if (is_cmd(buff, "pause")) {
+        cancel_set(&s->cancel, CANCEL_PAUSE);
+    } else if (is_cmd(buff, "resume")) {
+        cancel_set(&s->cancel, CANCEL_RUN);
+    }
+    return 0;
+}
+
+/* A client's first message: start its session, or answer "status". */
+static void session_start(int ep, struct session *s, const char *cmd,
+                          const char *default_cmd) {
+    size_t n;
+    int i;
+
+    /* Clients end the command with a newline (println); the arguments
+       do not. */
+    n = strcspn(cmd, "\r\n");
+    if (!n) {
+        cmd = default_cmd;
+        n = strlen(cmd);
+    }
+    snprintf(s->cmd, sizeof(s->cmd), "%.*s", (int) n, cmd);
+    if (is_cmd(s->cmd, "status")) {
+        send_status(s);
+        session_free(ep, s);
+        return;
+    }
+    if (is_cmd(s->cmd, "release")) {
+        alloc_drop_kept();
+        send(s->fd, "released\n", 9, MSG_NOSIGNAL);
+        session_free(ep, s);
+        return;
+    }
+    memcpy(s->args, s->cmd, sizeof(s->args));
+    s->argc = cmd_split(s->argv, s->args);
+    for (i = s->argc; i < SESSION_MAX_ARGS; i++) s->argv[i] = NULL;
+    s->state = SESSION_RUNNING;
+    if (pthread_create(&s->thread, NULL, session_main, s)) {
+        send(s->fd, "failed to start the test\n", 25, MSG_NOSIGNAL);
+        session_free(ep, s);
+    }
+}
+
+static void session_read(int ep, struct session *s, const char *default_cmd) {
+    char buff[SESSION_CMDLEN] = {0};
+    ssize_t n;
+
+    n = recv(s->fd, buff, sizeof(buff) - 1, 0);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    if (s->state == SESSION_COMMAND) {
+        if (n <= 0) {
+            session_free(ep, s);
+        } else {
+            session_start(ep, s, buff, default_cmd);
+        }
+        return;
+    }
+    /* Once stopped the fd stays open until the session is done. */
+    if (session_control(s, buff, n)) epoll_ctl(ep, EPOLL_CTL_DEL, s->fd, NULL);
+}
+
+/* Reads the controls of a session_run() session until it is stopped. */
+static void *control_main(void *arg) {
+    struct session *s = (struct session *) arg;
+    char buff[SESSION_CMDLEN];
+    ssize_t n;
+
+    do {
+        memset(buff, 0, sizeof(buff));
+        n = recv(s->fd, buff, sizeof(buff) - 1, 0);
+    } while ((n < 0 && errno == EINTR) || !session_control(s, buff, n));
+    return NULL;
+}
+
+/* Run the session for cmd on this thread, with the peer on fd as its
+   client; returns its exit code.  There is no manager: a thread reads
+   the peer's controls. */
+int session_run(int fd, const char *cmd, session_fn run) {
+    struct session *s;
+    pthread_t control;
+    int i;
+
+    s = (struct session *) calloc(1, sizeof(*s));
+    if (!s) return -1;
+    cancel_init(&s->cancel);
+    s->id = next_id++;
+    s->fd = fd;
+    snprintf(s->cmd, sizeof(s->cmd), "%s", cmd);
+    memcpy(s->args, s->cmd, sizeof(s->args));
+    s->argc = cmd_split(s->argv, s->args);
+    for (i = s->argc; i < SESSION_MAX_ARGS; i++) s->argv[i] = NULL;
+    s->state = SESSION_RUNNING;
+    pthread_once(&session_key_once, make_session_key);
+    pthread_setspecific(session_key, s);
+    if (!pthread_create(&control, NULL, control_main, s)) {
+        pthread_detach(control);
+    }
+    s->exit_code = run(s);
+    s->state = SESSION_DONE;
+    return s->exit_code;
+}
+
+/* Join and free the sessions which have finished. */
+static void session_reap(int ep) {
+    struct session *s;
+
+    while (read(done_pipe[0], &s, sizeof(s)) == sizeof(s)) {
+        pthread_join(s->thread, NULL);
+        s->state = SESSION_DONE;
+        session_free(ep, s);
+    }
+}
+
+/* Give up serving: close what session_serve() opened, keeping errno.  The
+   write end of done_pipe stays open while a test thread may still write
+   to it. */
+static int serve_fail(int ep) {
+    struct session *s;
+    int err = errno, busy = 0;
+
+    for (s = sessions; s; s = s->next) {
+        if (s->state == SESSION_RUNNING) busy = 1;
+    }
+    if (ep >= 0) close(ep);
+    if (done_pipe[0] >= 0) close(done_pipe[0]);
+    if (done_pipe[1] >= 0 && !busy) close(done_pipe[1]);
+    done_pipe[0] = -1;
+    if (!busy) done_pipe[1] = -1;
+    errno = err;
+    return -1;
+}
+
+/* Serve clients on listen_fd until something fatal happens; returns -1
+   with errno set.  An empty command runs default_cmd. */
+int session_serve(int listen_fd, session_fn run, const char *default_cmd) {
+    struct epoll_event ev, events[MAX_EVENTS];
+    struct session *s;
+    int ep, fd, n, i, reap;
+
+    run_session = run;
+    ep = epoll_create(MAX_EVENTS);
+    if (ep < 0 || pipe(done_pipe) < 0) return serve_fail(ep);
+    fcntl(done_pipe[0], F_SETFL, fcntl(done_pipe[0], F_GETFL) | O_NONBLOCK);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listen_tag;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        return serve_fail(ep);
+    }
+    ev.data.ptr = &done_tag;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, done_pipe[0], &ev) < 0) {
+        return serve_fail(ep);
+    }
+
+    while (1) {
+        n = epoll_wait(ep, events, MAX_EVENTS, paused_fd < 0 ? -1 :
+                       RETRY_MS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return serve_fail(ep);
+        }
+        /* Descriptors may have been freed by other processes. */
+        if (!n) listen_resume(ep);
+        reap = 0;
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr == &done_tag) {
+                reap = 1;
+            } else if (events[i].data.ptr == &listen_tag) {
+                fd = accept(listen_fd, NULL, NULL);
+                if (fd < 0) {
+                    if (errno == EMFILE || errno == ENFILE) {
+                        listen_pause(ep, listen_fd);
+                        continue;
+                    }
+                    if (errno == EINTR || errno == EAGAIN ||
+                        errno == ECONNABORTED) continue;
+                    return serve_fail(ep);
+                }
+                s = (struct session *) calloc(1, sizeof(*s));
+                ev.events = EPOLLIN;
+                ev.data.ptr = s;
+                if (!s || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                    free(s);
+                    close(fd);
+                    continue;
+                }
+                cancel_init(&s->cancel);
+                s->id = next_id++;
+                s->fd = fd;
+                s->state = SESSION_COMMAND;
+                s->next = sessions;
+                sessions = s;
+            } else {
+                session_read(ep, (struct session *) events[i].data.ptr,
+                             default_cmd);
+            }
+        }
+        /* Last, as later events of this batch may be for these sessions. */
+        if (reap) session_reap(ep);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the sessions, one per client
+ * command, and the loop which serves them.  See session.c.
+ *
+ */
+
+#ifndef MEMTESTER_SESSION_H
+#define MEMTESTER_SESSION_H
+
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "cancel.h"
+
+#define SESSION_CMDLEN      256         /* longest command from a client */
+#define SESSION_MAX_ARGS    32          /* words in a command */
+
+/* Where a session is. */
+#define SESSION_COMMAND     0           /* connected, waiting for the command */
+#define SESSION_RUNNING     1           /* its test thread is running */
+#define SESSION_DONE        2           /* finished, waiting to be reaped */
+
+struct event_sink;
+struct fail_log;
+struct physmap;
+struct badpages;
+
+/* One client and the test it asked for.  Everything a test run needs
+   lives here, so several can run at once. */
+struct session {
+    int id;
+    int fd;                             /* the client's socket */
+    int state;                          /* SESSION_* */
+    char cmd[SESSION_CMDLEN];           /* the command, as received */
+    char args[SESSION_CMDLEN];          /* the command split into argv */
+    int argc;
+    char *argv[SESSION_MAX_ARGS];
+    pthread_t thread;
+    struct cancel_token cancel;         /* stop, pause and resume */
+    int exit_code;
+    unsigned long volatile loop;        /* where the test is, for "status" */
+    const char * volatile test;
+
+    /* What the tests need to know; see tests.c. */
+    int use_phys;
+    off_t physaddrbase;
+    void volatile *test_base;
+    int use_nt_stores;
+    int evict_caches;
+    struct event_sink *events;
+    struct fail_log *fails;
+    struct physmap *physmap;            /* without -p, if readable */
+    struct badpages *badpages;          /* -b, or NULL */
+
+    struct session *next;
+};
+
+/* Runs one session's test on its own thread; returns its exit code. */
+typedef int (*session_fn)(struct session *s);
+
+/* Function declarations. */
+
+struct session *session_self(void);
+int session_serve(int listen_fd, session_fn run, const char *default_cmd);
+int session_run(int fd, const char *cmd, session_fn run);
+
+#endif /* MEMTESTER_SESSION_H */
@@ -0,0 +1,591 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the vectorized region primitives used by the tests in
+ * tests.c.  Every primitive has a portable scalar version; vector versions
+ * (SSE2, AVX2 and AVX-512 on x86, NEON on ARM) are compiled in where the
+ * compiler supports them, and simd_init() picks the best one the running CPU
+ * supports.  Setting the environment variable MEMTESTER_SIMD to the name of
+ * an implementation ("scalar", "sse2", "avx2", "avx512", "neon") forces that
+ * one, if the CPU supports it.
+ *
+ * The vector scanners only say which block of SIMD_BLOCK bytes holds the
+ * first difference; the caller then walks that block one word at a time to
+ * report the exact failing offsets.  The pattern scanners compare against a
+ * block of the expected alternating pattern kept in registers, so checking a
+ * buffer against a computed expectation costs one read per word.
+ *
+ * The fill primitives write the same alternating patterns.  fill_nt uses
+ * non-temporal stores (MOVNTDQ on x86, STNP on ARM64), which skip the read
+ * for ownership of each line and do not leave the data in the cache, so
+ * pattern writes run at full write bandwidth and really reach DRAM.  Where
+ * there is no such store (32-bit ARM, the scalar fallback) fill_nt is the
+ * same as fill.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define SIMD_X86 1
+  #include <immintrin.h>
+  #define SIMD_TARGET(t) __attribute__((target(t)))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #define SIMD_NEON 1
+  #include <arm_neon.h>
+#endif
+
+#define BLOCK_WORDS (SIMD_BLOCK / sizeof(ul))
+
+/* Scalar versions. */
+
+static size_t diff_scalar(const ul *a, const ul *b, size_t count) {
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        if ((a[i] ^ b[i]) | (a[i + 1] ^ b[i + 1]) |
+            (a[i + 2] ^ b[i + 2]) | (a[i + 3] ^ b[i + 3])) {
+            break;
+        }
+    }
+    for (; i < count; i++) {
+        if (a[i] != b[i]) break;
+    }
+    return i;
+}
+
+static size_t diff_pattern_scalar(const ul *buf, size_t count, ul even,
+                                  ul odd) {
+    size_t i;
+
+    for (i = 0; i + 2 <= count; i += 2) {
+        if ((buf[i] ^ even) | (buf[i + 1] ^ odd)) break;
+    }
+    for (; i < count; i++) {
+        if (buf[i] != ((i % 2) == 0 ? even : odd)) break;
+    }
+    return i;
+}
+
+/* One block of the expected pattern, for the vector scanners to load. */
+static void fill_block(ul *pat, ul even, ul odd) {
+    size_t i;
+
+    for (i = 0; i < BLOCK_WORDS; i++) {
+        pat[i] = (i % 2) == 0 ? even : odd;
+    }
+}
+
+static void fill_scalar(ul *buf, size_t count, ul even, ul odd) {
+    size_t i;
+
+    for (i = 0; i + 2 <= count; i += 2) {
+        buf[i] = even;
+        buf[i + 1] = odd;
+    }
+    if (i < count) {
+        buf[i] = even;
+    }
+}
+
+/* Write single words until buf + n is aligned to align bytes, for the
+   streaming stores which need aligned addresses.  Returns n. */
+static size_t fill_head(ul *buf, size_t count, ul even, ul odd,
+                        size_t align) {
+    size_t n = 0;
+
+    while (n < count && ((size_t) (buf + n) % align)) {
+        buf[n] = (n % 2) == 0 ? even : odd;
+        n++;
+    }
+    return n;
+}
+
+static int supported_always(void) {
+    return 1;
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static size_t diff_sse2(const ul *a, const ul *b, size_t count) {
+    const __m128i *pa, *pb;
+    __m128i acc;
+    size_t i;
+    int k;
+
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        pa = (const __m128i *) (a + i);
+        pb = (const __m128i *) (b + i);
+        acc = _mm_setzero_si128();
+        for (k = 0; k < SIMD_BLOCK / 16; k++) {
+            acc = _mm_or_si128(acc, _mm_xor_si128(_mm_loadu_si128(pa + k),
+                                                  _mm_loadu_si128(pb + k)));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128()))
+            != 0xffff) {
+            return i;
+        }
+    }
+    return i + diff_scalar(a + i, b + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+static size_t diff_avx2(const ul *a, const ul *b, size_t count) {
+    const __m256i *pa, *pb;
+    __m256i acc;
+    size_t i;
+    int k;
+
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        pa = (const __m256i *) (a + i);
+        pb = (const __m256i *) (b + i);
+        acc = _mm256_setzero_si256();
+        for (k = 0; k < SIMD_BLOCK / 32; k++) {
+            acc = _mm256_or_si256(acc,
+                                  _mm256_xor_si256(_mm256_loadu_si256(pa + k),
+                                                   _mm256_loadu_si256(pb + k)));
+        }
+        if (!_mm256_testz_si256(acc, acc)) {
+            return i;
+        }
+    }
+    return i + diff_scalar(a + i, b + i, count - i);
+}
+
+SIMD_TARGET("avx512f")
+static size_t diff_avx512(const ul *a, const ul *b, size_t count) {
+    const __m512i *pa, *pb;
+    __m512i acc;
+    size_t i;
+    int k;
+
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        pa = (const __m512i *) (a + i);
+        pb = (const __m512i *) (b + i);
+        acc = _mm512_setzero_si512();
+        for (k = 0; k < SIMD_BLOCK / 64; k++) {
+            acc = _mm512_or_si512(acc,
+                                  _mm512_xor_si512(_mm512_loadu_si512(pa + k),
+                                                   _mm512_loadu_si512(pb + k)));
+        }
+        if (_mm512_test_epi64_mask(acc, acc)) {
+            return i;
+        }
+    }
+    return i + diff_scalar(a + i, b + i, count - i);
+}
+
+SIMD_TARGET("sse2")
+static size_t diff_pattern_sse2(const ul *buf, size_t count, ul even,
+                                ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    __m128i expect[SIMD_BLOCK / 16];
+    const __m128i *p;
+    __m128i acc;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    for (k = 0; k < SIMD_BLOCK / 16; k++) {
+        expect[k] = _mm_load_si128((const __m128i *) pat + k);
+    }
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (const __m128i *) (buf + i);
+        acc = _mm_setzero_si128();
+        for (k = 0; k < SIMD_BLOCK / 16; k++) {
+            acc = _mm_or_si128(acc, _mm_xor_si128(_mm_loadu_si128(p + k),
+                                                  expect[k]));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128()))
+            != 0xffff) {
+            return i;
+        }
+    }
+    return i + diff_pattern_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("avx2")
+static size_t diff_pattern_avx2(const ul *buf, size_t count, ul even,
+                                ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    __m256i expect[SIMD_BLOCK / 32];
+    const __m256i *p;
+    __m256i acc;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    for (k = 0; k < SIMD_BLOCK / 32; k++) {
+        expect[k] = _mm256_load_si256((const __m256i *) pat + k);
+    }
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (const __m256i *) (buf + i);
+        acc = _mm256_setzero_si256();
+        for (k = 0; k < SIMD_BLOCK / 32; k++) {
+            acc = _mm256_or_si256(acc,
+                                  _mm256_xor_si256(_mm256_loadu_si256(p + k),
+                                                   expect[k]));
+        }
+        if (!_mm256_testz_si256(acc, acc)) {
+            return i;
+        }
+    }
+    return i + diff_pattern_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("avx512f")
+static size_t diff_pattern_avx512(const ul *buf, size_t count, ul even,
+                                  ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    __m512i expect[SIMD_BLOCK / 64];
+    const __m512i *p;
+    __m512i acc;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    for (k = 0; k < SIMD_BLOCK / 64; k++) {
+        expect[k] = _mm512_load_si512((const __m512i *) pat + k);
+    }
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (const __m512i *) (buf + i);
+        acc = _mm512_setzero_si512();
+        for (k = 0; k < SIMD_BLOCK / 64; k++) {
+            acc = _mm512_or_si512(acc,
+                                  _mm512_xor_si512(_mm512_loadu_si512(p + k),
+                                                   expect[k]));
+        }
+        if (_mm512_test_epi64_mask(acc, acc)) {
+            return i;
+        }
+    }
+    return i + diff_pattern_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("sse2")
+static void fill_sse2(ul *buf, size_t count, ul even, ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    __m128i v, *p;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    v = _mm_load_si128((const __m128i *) pat);
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (__m128i *) (buf + i);
+        for (k = 0; k < SIMD_BLOCK / 16; k++) {
+            _mm_storeu_si128(p + k, v);
+        }
+    }
+    fill_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("sse2")
+static void fill_nt_sse2(ul *buf, size_t count, ul even, ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    size_t head = fill_head(buf, count, even, odd, 16);
+    __m128i v, *p;
+    ul t;
+    size_t i;
+    int k;
+
+    buf += head;
+    count -= head;
+    if (head % 2) {
+        t = even;
+        even = odd;
+        odd = t;
+    }
+    fill_block(pat, even, odd);
+    v = _mm_load_si128((const __m128i *) pat);
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (__m128i *) (buf + i);
+        for (k = 0; k < SIMD_BLOCK / 16; k++) {
+            _mm_stream_si128(p + k, v);
+        }
+    }
+    _mm_sfence();
+    fill_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("avx2")
+static void fill_avx2(ul *buf, size_t count, ul even, ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    __m256i v, *p;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    v = _mm256_load_si256((const __m256i *) pat);
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (__m256i *) (buf + i);
+        for (k = 0; k < SIMD_BLOCK / 32; k++) {
+            _mm256_storeu_si256(p + k, v);
+        }
+    }
+    fill_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("avx2")
+static void fill_nt_avx2(ul *buf, size_t count, ul even, ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    size_t head = fill_head(buf, count, even, odd, 32);
+    __m256i v, *p;
+    ul t;
+    size_t i;
+    int k;
+
+    buf += head;
+    count -= head;
+    if (head % 2) {
+        t = even;
+        even = odd;
+        odd = t;
+    }
+    fill_block(pat, even, odd);
+    v = _mm256_load_si256((const __m256i *) pat);
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (__m256i *) (buf + i);
+        for (k = 0; k < SIMD_BLOCK / 32; k++) {
+            _mm256_stream_si256(p + k, v);
+        }
+    }
+    _mm_sfence();
+    fill_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("avx512f")
+static void fill_avx512(ul *buf, size_t count, ul even, ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    __m512i v, *p;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    v = _mm512_load_si512((const __m512i *) pat);
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (__m512i *) (buf + i);
+        for (k = 0; k < SIMD_BLOCK / 64; k++) {
+            _mm512_storeu_si512(p + k, v);
+        }
+    }
+    fill_scalar(buf + i, count - i, even, odd);
+}
+
+SIMD_TARGET("avx512f")
+static void fill_nt_avx512(ul *buf, size_t count, ul even, ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(64)));
+    size_t head = fill_head(buf, count, even, odd, 64);
+    __m512i v, *p;
+    ul t;
+    size_t i;
+    int k;
+
+    buf += head;
+    count -= head;
+    if (head % 2) {
+        t = even;
+        even = odd;
+        odd = t;
+    }
+    fill_block(pat, even, odd);
+    v = _mm512_load_si512((const __m512i *) pat);
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (__m512i *) (buf + i);
+        for (k = 0; k < SIMD_BLOCK / 64; k++) {
+            _mm512_stream_si512(p + k, v);
+        }
+    }
+    _mm_sfence();
+    fill_scalar(buf + i, count - i, even, odd);
+}
+
+static int supported_sse2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static int supported_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static int supported_avx512(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+#endif /* SIMD_X86 */
+
+#ifdef SIMD_NEON
+
+static size_t diff_neon(const ul *a, const ul *b, size_t count) {
+    const unsigned char *pa, *pb;
+    uint8x16_t acc;
+    uint64x2_t acc64;
+    size_t i;
+    int k;
+
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        pa = (const unsigned char *) (a + i);
+        pb = (const unsigned char *) (b + i);
+        acc = vdupq_n_u8(0);
+        for (k = 0; k < SIMD_BLOCK / 16; k++) {
+            acc = vorrq_u8(acc, veorq_u8(vld1q_u8(pa + 16 * k),
+                                         vld1q_u8(pb + 16 * k)));
+        }
+        acc64 = vreinterpretq_u64_u8(acc);
+        if (vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1)) {
+            return i;
+        }
+    }
+    return i + diff_scalar(a + i, b + i, count - i);
+}
+
+static size_t diff_pattern_neon(const ul *buf, size_t count, ul even,
+                                ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(16)));
+    uint8x16_t expect[SIMD_BLOCK / 16];
+    const unsigned char *p;
+    uint8x16_t acc;
+    uint64x2_t acc64;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    for (k = 0; k < SIMD_BLOCK / 16; k++) {
+        expect[k] = vld1q_u8((const unsigned char *) pat + 16 * k);
+    }
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (const unsigned char *) (buf + i);
+        acc = vdupq_n_u8(0);
+        for (k = 0; k < SIMD_BLOCK / 16; k++) {
+            acc = vorrq_u8(acc, veorq_u8(vld1q_u8(p + 16 * k), expect[k]));
+        }
+        acc64 = vreinterpretq_u64_u8(acc);
+        if (vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1)) {
+            return i;
+        }
+    }
+    return i + diff_pattern_scalar(buf + i, count - i, even, odd);
+}
+
+static void fill_neon(ul *buf, size_t count, ul even, ul odd) {
+    ul pat[BLOCK_WORDS] __attribute__((aligned(16)));
+    unsigned char *p;
+    uint8x16_t v;
+    size_t i;
+    int k;
+
+    fill_block(pat, even, odd);
+    v = vld1q_u8((const unsigned char *) pat);
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = (unsigned char *) (buf + i);
+        for (k = 0; k < SIMD_BLOCK / 16; k++) {
+            vst1q_u8(p + 16 * k, v);
+        }
+    }
+    fill_scalar(buf + i, count - i, even, odd);
+}
+
+#ifdef __aarch64__
+/* STNP of an (even, odd) register pair writes one period of the pattern
+   with a non-temporal hint. */
+static void fill_nt_neon(ul *buf, size_t count, ul even, ul odd) {
+    size_t head = fill_head(buf, count, even, odd, 16);
+    ul *p, t;
+    size_t i;
+    int k;
+
+    buf += head;
+    count -= head;
+    if (head % 2) {
+        t = even;
+        even = odd;
+        odd = t;
+    }
+    for (i = 0; i + BLOCK_WORDS <= count; i += BLOCK_WORDS) {
+        p = buf + i;
+        for (k = 0; k < (int) BLOCK_WORDS; k += 2) {
+            __asm__ volatile("stnp %1, %2, [%0]"
+                             : : "r" (p + k), "r" (even), "r" (odd)
+                             : "memory");
+        }
+    }
+    __asm__ volatile("dmb ishst" : : : "memory");
+    fill_scalar(buf + i, count - i, even, odd);
+}
+#else
+#define fill_nt_neon fill_neon
+#endif
+
+#endif /* SIMD_NEON */
+
+struct simd_impl {
+    int (*supported)(void);
+    struct simd_ops ops;
+};
+
+/* Best first; the scalar entry must stay last. */
+static const struct simd_impl impls[] = {
+#ifdef SIMD_X86
+    { supported_avx512, { "avx512", diff_avx512, diff_pattern_avx512,
+                          fill_avx512, fill_nt_avx512 } },
+    { supported_avx2, { "avx2", diff_avx2, diff_pattern_avx2,
+                        fill_avx2, fill_nt_avx2 } },
+    { supported_sse2, { "sse2", diff_sse2, diff_pattern_sse2,
+                        fill_sse2, fill_nt_sse2 } },
+#endif
+#ifdef SIMD_NEON
+    { supported_always, { "neon", diff_neon, diff_pattern_neon,
+                          fill_neon, fill_nt_neon } },
+#endif
+    { supported_always, { "scalar", diff_scalar, diff_pattern_scalar,
+                          fill_scalar, fill_scalar } },
+};
+
+#define NIMPLS (sizeof(impls) / sizeof(impls[0]))
+
+const struct simd_ops *simd = &impls[NIMPLS - 1].ops;
+
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+
+static void simd_select(void) {
+    char *want = getenv("MEMTESTER_SIMD");
+    size_t i;
+
+    for (i = 0; i < NIMPLS; i++) {
+        if (want && strcmp(want, impls[i].ops.name)) continue;
+        if (impls[i].supported()) {
+            simd = &impls[i].ops;
+            return;
+        }
+    }
+    /* Unknown or unsupported override: fall back to the best we have. */
+    for (i = 0; i < NIMPLS; i++) {
+        if (impls[i].supported()) {
+            simd = &impls[i].ops;
+            return;
+        }
+    }
+}
+
+void simd_init(void) {
+    pthread_once(&simd_once, simd_select);
+}
@@ -0,0 +1,51 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the vectorized region primitives
+ * used by the tests.  See simd.c.
+ *
+ */
+
+#ifndef MEMTESTER_SIMD_H
+#define MEMTESTER_SIMD_H
+
+#include <sys/types.h>
+
+/* Vector kernels scan in blocks of this many bytes. */
+#define SIMD_BLOCK 128
+
+struct simd_ops {
+    const char *name;
+    /* Index of the first SIMD_BLOCK-sized block of a and b that differs,
+       or count if the two regions are equal.  Words before the returned
+       index are known to match. */
+    size_t (*diff)(const unsigned long *a, const unsigned long *b,
+                   size_t count);
+    /* Same, comparing buf against the pattern even, odd, even, odd, ...
+       buf must start at an even word of the pattern. */
+    size_t (*diff_pattern)(const unsigned long *buf, size_t count,
+                           unsigned long even, unsigned long odd);
+    /* Write the pattern even, odd, even, odd, ... to buf, through the
+       cache (fill) or with non-temporal stores that go straight to memory
+       without reading the lines first (fill_nt). */
+    void (*fill)(unsigned long *buf, size_t count, unsigned long even,
+                 unsigned long odd);
+    void (*fill_nt)(unsigned long *buf, size_t count, unsigned long even,
+                    unsigned long odd);
+};
+
+/* Selected at startup by simd_init(). */
+extern const struct simd_ops *simd;
+
+/* Function declarations. */
+
+void simd_init(void);
+
+#endif /* MEMTESTER_SIMD_H */
@@ -0,0 +1,106 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the throughput figures reported with each test and in
+ * the summary at the end of a session.  The tests charge the time and the
+ * bytes read plus written of each write and verify phase to their worker
+ * (see phase_done() in tests.c); after a run these are added up over the
+ * workers.  The workers run in parallel, so a phase takes as long as its
+ * slowest worker.  GB/s are 10^9 bytes per second, and ns/word is the wall
+ * time per word moved by all threads together.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+
+static const char *phase_names[PHASES] = { "write", "verify" };
+
+static double gbps(unsigned long long bytes, unsigned long long ns) {
+    return ns ? (double) bytes / (double) ns : 0.0;
+}
+
+static double ns_per_word(unsigned long long bytes, unsigned long long ns) {
+    return bytes ? (double) ns * sizeof(unsigned long) / (double) bytes : 0.0;
+}
+
+/* Add up what the workers did in the last engine_run(), which took ns. */
+void stats_collect(struct engine *e, unsigned long long ns,
+                   struct test_sample *t) {
+    struct worker *w;
+    int i, p;
+
+    memset(t, 0, sizeof(*t));
+    t->ns = ns;
+    for (i = 0; i < e->nthreads; i++) {
+        w = &e->workers[i];
+        for (p = 0; p < PHASES; p++) {
+            t->phase_bytes[p] += w->phase_bytes[p];
+            if (w->phase_ns[p] > t->phase_ns[p]) t->phase_ns[p] = w->phase_ns[p];
+        }
+    }
+    for (p = 0; p < PHASES; p++) {
+        t->bytes += t->phase_bytes[p];
+    }
+}
+
+void stats_add(struct test_stats *s, const struct test_sample *t, int failed) {
+    double rate = gbps(t->bytes, t->ns);
+    int p;
+
+    if (!s->runs || rate < s->min_gbps) s->min_gbps = rate;
+    if (!s->runs || rate > s->max_gbps) s->max_gbps = rate;
+    s->runs++;
+    if (failed) s->failures++;
+    s->total.ns += t->ns;
+    s->total.bytes += t->bytes;
+    for (p = 0; p < PHASES; p++) {
+        s->total.phase_ns[p] += t->phase_ns[p];
+        s->total.phase_bytes[p] += t->phase_bytes[p];
+    }
+}
+
+/* " (120 ms, 512 MB, 4.27 GB/s, 1.87 ns/word; write 6.10 GB/s, verify
+   3.30 GB/s)" for the result line of one run. */
+int stats_format_sample(char *buf, size_t len, const struct test_sample *t) {
+    int n, p;
+
+    n = snprintf(buf, len, " (%llu ms, %llu MB, %.2f GB/s, %.2f ns/word",
+                 t->ns / 1000000, t->bytes >> 20, gbps(t->bytes, t->ns),
+                 ns_per_word(t->bytes, t->ns));
+    for (p = 0; p < PHASES && n > 0 && (size_t) n < len; p++) {
+        if (!t->phase_bytes[p]) continue;
+        n += snprintf(buf + n, len - n, "%s %s %.2f GB/s",
+                      p && t->phase_bytes[0] ? "," : ";", phase_names[p],
+                      gbps(t->phase_bytes[p], t->phase_ns[p]));
+    }
+    if (n > 0 && (size_t) n < len) n += snprintf(buf + n, len - n, ")");
+    return n;
+}
+
+int stats_format_header(char *buf, size_t len) {
+    return snprintf(buf, len, "  %-20s %5s %5s %9s %8s %8s %8s %8s %8s\n",
+                    "test", "runs", "fail", "MB", "GB/s", "min", "max",
+                    "ns/word", "verify");
+}
+
+/* One line of the session summary; "verify" is the verify phase's GB/s. */
+int stats_format_row(char *buf, size_t len, const struct test_stats *s) {
+    return snprintf(buf, len,
+                    "  %-20s %5lu %5lu %9llu %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+                    s->name, s->runs, s->failures, s->total.bytes >> 20,
+                    gbps(s->total.bytes, s->total.ns), s->min_gbps,
+                    s->max_gbps, ns_per_word(s->total.bytes, s->total.ns),
+                    gbps(s->total.phase_bytes[PHASE_VERIFY],
+                         s->total.phase_ns[PHASE_VERIFY]));
+}
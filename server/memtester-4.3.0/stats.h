@@ -0,0 +1,50 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the declarations for the per-test throughput figures.
+ * See stats.c.
+ *
+ */
+
+#ifndef MEMTESTER_STATS_H
+#define MEMTESTER_STATS_H
+
+#include <sys/types.h>
+
+#include "engine.h"
+
+/* What one engine_run() of a test did. */
+struct test_sample {
+    unsigned long long ns;              /* wall time of the run */
+    unsigned long long bytes;           /* read plus written, all phases */
+    unsigned long long phase_ns[PHASES];
+    unsigned long long phase_bytes[PHASES];
+};
+
+/* All runs of one test in a session. */
+struct test_stats {
+    const char *name;
+    unsigned long runs;
+    unsigned long failures;
+    struct test_sample total;
+    double min_gbps;
+    double max_gbps;
+};
+
+/* Function declarations. */
+
+void stats_collect(struct engine *e, unsigned long long ns,
+                   struct test_sample *t);
+void stats_add(struct test_stats *s, const struct test_sample *t, int failed);
+int stats_format_sample(char *buf, size_t len, const struct test_sample *t);
+int stats_format_header(char *buf, size_t len);
+int stats_format_row(char *buf, size_t len, const struct test_stats *s);
+
+#endif /* MEMTESTER_STATS_H */
@@ -19,107 +19,287 @@
 #include <limits.h>
 
 #include "types.h"
+#include "tests.h"
 #include "sizes.h"
 #include "memtester.h"
+#include "simd.h"
+#include "prng.h"
+#include "engine.h"
+#include "cache.h"
+#include "timing.h"
+#include "events.h"
+#include "failures.h"
+#include "physmap.h"
+#include "badpages.h"
 
-char progress[] = "-\\|/";
-#define PROGRESSLEN 4
-#define PROGRESSOFTEN 2500
 #define ONE 0x00000001L
+#define BLOCK_WORDS (SIMD_BLOCK / sizeof(ul))
+/* Words between checks of the session's cancellation token, 1 MB on 64-bit
+   machines; a multiple of BLOCK_WORDS and even, so a chunked scan or fill
+   stays in phase. */
+#define CHUNK_WORDS ((size_t) 1 << 17)
 
 /* Function definitions. */
 
+/* The physical address of the byte at offset into the region: from -p,
+   or else from the pagemap table if there is one.  Returns 0 if unknown. */
+static int failure_phys(struct session *s, size_t offset,
+                        unsigned long long *phys) {
+    if (s->use_phys) {
+        *phys = (unsigned long long) s->physaddrbase + offset;
+        return 1;
+    }
+    return s->physmap && !physmap_lookup(s->physmap, offset, phys);
+}
+
+/* With -b a failing pattern does not end the test: the rest of its
+   patterns still run, and its pages are left out of the tests after it. */
+static int keep_going(void) {
+    struct session *s = session_self();
+
+    return s && s->badpages;
+}
+
+/* Count the failure; only the first few of a test are sent on their own,
+   as kind, then a running total now and then, see failures.c. */
+static void report_failure(ulv *p, const char *kind, ul actual,
+                           ul expected) {
+    struct session *s = session_self();
+    struct worker *w = worker_self();
+    size_t offset = (size_t) p - (size_t) s->test_base;
+    unsigned long long phys = 0;
+    int known;
+
+    fail_record(w->fails, offset, actual, expected);
+    if (s->badpages) badpages_add(s->badpages, offset);
+    if (fail_detail(s->fails)) {
+        known = failure_phys(s, offset, &phys);
+        ev_failure(s->events, kind, offset, known, phys, actual, expected);
+    } else if (!(w->fails->words % 1024) && fail_due(s->fails)) {
+        ev_failures_so_far(s->events, s->fails->test, fail_words(s->fails));
+    }
+}
+
+static void report_mismatch(ulv *p, ul actual, ul expected) {
+    report_failure(p, "mismatch", actual, expected);
+}
+
+/* A block differed when scanned but reads back equal: an intermittent
+   fault, which is still a failure. */
+static void report_transient(ulv *p) {
+    struct session *s = session_self();
+    size_t offset = (size_t) p - (size_t) s->test_base;
+    unsigned long long phys = 0;
+    int known;
+
+    fail_record_transient(worker_self()->fails, offset);
+    if (s->badpages) badpages_add(s->badpages, offset);
+    if (fail_detail(s->fails)) {
+        known = failure_phys(s, offset, &phys);
+        ev_failure(s->events, "transient", offset, known, phys, 0, 0);
+    }
+}
+
+/* With -f, push the buffers that were just written out of the caches so
+   they are verified from memory.  The time this takes is charged to the
+   worker, to be reported with the test. */
+static void evict_for_verify(ulv *bufa, ulv *bufb, size_t count) {
+    struct worker *w;
+    unsigned long long start;
+
+    if (!session_self()->evict_caches) return;
+    start = now_ns();
+    cache_evict(bufa, bufb, count * sizeof(ul));
+    if ((w = worker_self())) w->evict_ns += now_ns() - start;
+}
+
+/* A kernel about to go over its count words passes times (a write and a
+   verify are one pass each) tells the progress reporter, see progress.c. */
+static void plan(unsigned int passes, size_t count) {
+    struct worker *w = worker_self();
+
+    if (!w) return;
+    __atomic_store_n(&w->work_total,
+                     w->work_total + (unsigned long long) passes * count,
+                     __ATOMIC_RELAXED);
+}
+
+/* Called every CHUNK_WORDS words, with i words of the pass done: publish
+   the worker's progress, then a paused session waits here, and a stopped
+   one makes the test return early.  The session then discards the test's
+   result, so returning 0 is fine. */
+static int stopping(size_t i) {
+    struct session *s = session_self();
+    struct worker *w = worker_self();
+
+    if (w) __atomic_store_n(&w->work_done, w->work_base + i, __ATOMIC_RELAXED);
+    return s && cancel_point(&s->cancel);
+}
+
+/* Charge a write or verify phase over count words that began at start and
+   moved bytes (read plus written) to the calling worker, for the
+   throughput report and its progress.  A pass that updates both buffers
+   in place, as the xor, sub, mul, div, or and and comparisons do, reads
+   and writes each word of both: 4 * count words. */
+static void phase_done(int phase, unsigned long long start, size_t count,
+                       size_t bytes) {
+    struct worker *w = worker_self();
+
+    if (!w) return;
+    w->phase_ns[phase] += now_ns() - start;
+    w->phase_bytes[phase] += bytes;
+    w->work_base += count;
+    __atomic_store_n(&w->work_done, w->work_base, __ATOMIC_RELAXED);
+}
+
 int compare_regions(ulv *bufa, ulv *bufb, size_t count) {
-    int r = 0;
-    size_t i;
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
-    off_t physaddr;
-
-    for (i = 0; i < count; i++, p1++, p2++) {
-        if (*p1 != *p2) {
-            if (use_phys) {
-                physaddr = physaddrbase + (i * sizeof(ul));
-                fprintf(stderr, 
-                        "FAILURE: 0x%08lx != 0x%08lx at physical address "
-                        "0x%08lx.\n", 
-                        (ul) *p1, (ul) *p2, physaddr);
-            } else {
-                fprintf(stderr, 
-                        "FAILURE: 0x%08lx != 0x%08lx at offset 0x%08lx.\n", 
-                        (ul) *p1, (ul) *p2, (ul) (i * sizeof(ul)));
+    int r = 0, found;
+    size_t i = 0, start, end, lim;
+    ulv *p1;
+    ulv *p2;
+    ul v1, v2;
+    unsigned long long t0;
+
+    evict_for_verify(bufa, bufb, count);
+    t0 = now_ns();
+    while (i < count) {
+        if (stopping(i)) return r;
+        /* Skip the matching part with the vector scanner, then walk the
+           block it stopped at word by word to report the exact offsets. */
+        lim = (count - i > CHUNK_WORDS) ? i + CHUNK_WORDS : count;
+        i += simd->diff((const ul *) (bufa + i), (const ul *) (bufb + i),
+                        lim - i);
+        if (i >= lim) continue;
+        end = (i + BLOCK_WORDS < count) ? i + BLOCK_WORDS : count;
+        start = i;
+        found = 0;
+        for (p1 = bufa + i, p2 = bufb + i; i < end; i++, p1++, p2++) {
+            v1 = *p1;
+            v2 = *p2;
+            if (v1 != v2) {
+                report_mismatch(p1, v1, v2);
+                /* printf("Skipping to next test..."); */
+                found = 1;
+                r = -1;
+            }
+        }
+        if (!found) {
+            report_transient(bufa + start);
+            r = -1;
+        }
+    }
+    phase_done(PHASE_VERIFY, t0, count, 2 * count * sizeof(ul));
+    return r;
+}
+
+/* Check buf against the computed pattern even, odd, even, ... rather than
+   against a second copy. */
+int compare_pattern(ulv *buf, size_t count, ul even, ul odd) {
+    int r = 0, found;
+    size_t i = 0, start, end, lim;
+    ulv *p;
+    ul v, q;
+    unsigned long long t0;
+
+    evict_for_verify(buf, NULL, count);
+    t0 = now_ns();
+    while (i < count) {
+        if (stopping(i)) return r;
+        lim = (count - i > CHUNK_WORDS) ? i + CHUNK_WORDS : count;
+        i += simd->diff_pattern((const ul *) (buf + i), lim - i, even, odd);
+        if (i >= lim) continue;
+        /* Restart on a block boundary so the next scan stays in phase. */
+        i -= i % BLOCK_WORDS;
+        end = (i + BLOCK_WORDS < count) ? i + BLOCK_WORDS : count;
+        start = i;
+        found = 0;
+        for (p = buf + i; i < end; i++, p++) {
+            q = (i % 2) == 0 ? even : odd;
+            v = *p;
+            if (v != q) {
+                report_mismatch(p, v, q);
+                found = 1;
+                r = -1;
             }
-            /* printf("Skipping to next test..."); */
+        }
+        if (!found) {
+            report_transient(buf + start);
             r = -1;
         }
     }
+    phase_done(PHASE_VERIFY, t0, count, count * sizeof(ul));
     return r;
 }
 
+/* Write even, odd, even, ... to buf; with -n through streaming stores. */
+static void fill_pattern(ulv *buf, size_t count, ul even, ul odd) {
+    unsigned long long t0 = now_ns();
+    int nt = session_self()->use_nt_stores;
+    size_t i, n;
+
+    for (i = 0; i < count; i += n) {
+        if (stopping(i)) return;
+        n = (count - i > CHUNK_WORDS) ? CHUNK_WORDS : count - i;
+        if (nt) {
+            simd->fill_nt((ul *) (buf + i), n, even, odd);
+        } else {
+            simd->fill((ul *) (buf + i), n, even, odd);
+        }
+    }
+    phase_done(PHASE_WRITE, t0, count, count * sizeof(ul));
+}
+
 int test_stuck_address(ulv *bufa, size_t count) {
     ulv *p1 = bufa;
     unsigned int j;
     size_t i;
-    off_t physaddr;
+    ul q;
+    unsigned long long t0;
 
-    printf("           ");
-    fflush(stdout);
+    /* Planned per call: the worker's halves, and with -b each range
+       between bad pages, add up to its job. */
+    plan(16 * 2, count);
     for (j = 0; j < 16; j++) {
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
         p1 = (ulv *) bufa;
-        printf("setting %3u", j);
-        fflush(stdout);
+        t0 = now_ns();
         for (i = 0; i < count; i++) {
+            if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
             *p1 = ((j + i) % 2) == 0 ? (ul) p1 : ~((ul) p1);
             *p1++;
         }
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        printf("testing %3u", j);
-        fflush(stdout);
+        phase_done(PHASE_WRITE, t0, count, count * sizeof(ul));
+        evict_for_verify(bufa, NULL, count);
+        t0 = now_ns();
         p1 = (ulv *) bufa;
         for (i = 0; i < count; i++, p1++) {
-            if (*p1 != (((j + i) % 2) == 0 ? (ul) p1 : ~((ul) p1))) {
-                if (use_phys) {
-                    physaddr = physaddrbase + (i * sizeof(ul));
-                    fprintf(stderr, 
-                            "FAILURE: possible bad address line at physical "
-                            "address 0x%08lx.\n", 
-                            physaddr);
-                } else {
-                    fprintf(stderr, 
-                            "FAILURE: possible bad address line at offset "
-                            "0x%08lx.\n", 
-                            (ul) (i * sizeof(ul)));
-                }
-                printf("Skipping to next test...\n");
-                fflush(stdout);
+            if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
+            q = ((j + i) % 2) == 0 ? (ul) p1 : ~((ul) p1);
+            if (*p1 != q) {
+                /* A word holding another word's address: the first one
+                   is enough to fail the test. */
+                report_failure(p1, "address line", *p1, q);
                 return -1;
             }
         }
+        phase_done(PHASE_VERIFY, t0, count, count * sizeof(ul));
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 int test_random_value(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
-    ul j = 0;
+    struct prng *rng = prng_self();
     size_t i;
+    unsigned long long t0;
 
-    putchar(' ');
-    fflush(stdout);
+    plan(2, count);
+    t0 = now_ns();
     for (i = 0; i < count; i++) {
-        *p1++ = *p2++ = rand_ul();
-        if (!(i % PROGRESSOFTEN)) {
-            putchar('\b');
-            putchar(progress[++j % PROGRESSLEN]);
-            fflush(stdout);
-        }
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
+        *p1++ = *p2++ = prng_ul(rng);
     }
-    printf("\b \b");
-    fflush(stdout);
+    phase_done(PHASE_WRITE, t0, count, 2 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
@@ -127,12 +307,16 @@ int test_xor_comparison(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
     size_t i;
-    ul q = rand_ul();
+    ul q = prng_ul(prng_self());
+    unsigned long long t0 = now_ns();
 
+    plan(2, count);
     for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
         *p1++ ^= q;
         *p2++ ^= q;
     }
+    phase_done(PHASE_WRITE, t0, count, 4 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
@@ -140,12 +324,16 @@ int test_sub_comparison(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
     size_t i;
-    ul q = rand_ul();
+    ul q = prng_ul(prng_self());
+    unsigned long long t0 = now_ns();
 
+    plan(2, count);
     for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
         *p1++ -= q;
         *p2++ -= q;
     }
+    phase_done(PHASE_WRITE, t0, count, 4 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
@@ -153,12 +341,16 @@ int test_mul_comparison(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
     size_t i;
-    ul q = rand_ul();
+    ul q = prng_ul(prng_self());
+    unsigned long long t0 = now_ns();
 
+    plan(2, count);
     for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
         *p1++ *= q;
         *p2++ *= q;
     }
+    phase_done(PHASE_WRITE, t0, count, 4 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
@@ -166,15 +358,19 @@ int test_div_comparison(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
     size_t i;
-    ul q = rand_ul();
+    ul q = prng_ul(prng_self());
+    unsigned long long t0 = now_ns();
 
+    plan(2, count);
     for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
         if (!q) {
             q++;
         }
         *p1++ /= q;
         *p2++ /= q;
     }
+    phase_done(PHASE_WRITE, t0, count, 4 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
@@ -182,12 +378,16 @@ int test_or_comparison(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
     size_t i;
-    ul q = rand_ul();
+    ul q = prng_ul(prng_self());
+    unsigned long long t0 = now_ns();
 
+    plan(2, count);
     for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
         *p1++ |= q;
         *p2++ |= q;
     }
+    phase_done(PHASE_WRITE, t0, count, 4 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
@@ -195,12 +395,16 @@ int test_and_comparison(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
     size_t i;
-    ul q = rand_ul();
+    ul q = prng_ul(prng_self());
+    unsigned long long t0 = now_ns();
 
+    plan(2, count);
     for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
         *p1++ &= q;
         *p2++ &= q;
     }
+    phase_done(PHASE_WRITE, t0, count, 4 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
@@ -208,254 +412,157 @@ int test_seqinc_comparison(ulv *bufa, ulv *bufb, size_t count) {
     ulv *p1 = bufa;
     ulv *p2 = bufb;
     size_t i;
-    ul q = rand_ul();
+    ul q = prng_ul(prng_self());
+    unsigned long long t0 = now_ns();
 
+    plan(2, count);
     for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
         *p1++ = *p2++ = (i + q);
     }
+    phase_done(PHASE_WRITE, t0, count, 2 * count * sizeof(ul));
     return compare_regions(bufa, bufb, count);
 }
 
 int test_solidbits_comparison(ulv *bufa, ulv *bufb, size_t count) {
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
     unsigned int j;
     ul q;
-    size_t i;
 
-    printf("           ");
-    fflush(stdout);
+    plan(64 * 3, count);
     for (j = 0; j < 64; j++) {
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
         q = (j % 2) == 0 ? UL_ONEBITS : 0;
-        printf("setting %3u", j);
-        fflush(stdout);
-        p1 = (ulv *) bufa;
-        p2 = (ulv *) bufb;
-        for (i = 0; i < count; i++) {
-            *p1++ = *p2++ = (i % 2) == 0 ? q : ~q;
-        }
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        printf("testing %3u", j);
-        fflush(stdout);
-        if (compare_regions(bufa, bufb, count)) {
+        fill_pattern(bufa, count, q, ~q);
+        fill_pattern(bufb, count, q, ~q);
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 int test_checkerboard_comparison(ulv *bufa, ulv *bufb, size_t count) {
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
     unsigned int j;
     ul q;
-    size_t i;
 
-    printf("           ");
-    fflush(stdout);
+    plan(64 * 3, count);
     for (j = 0; j < 64; j++) {
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
         q = (j % 2) == 0 ? CHECKERBOARD1 : CHECKERBOARD2;
-        printf("setting %3u", j);
-        fflush(stdout);
-        p1 = (ulv *) bufa;
-        p2 = (ulv *) bufb;
-        for (i = 0; i < count; i++) {
-            *p1++ = *p2++ = (i % 2) == 0 ? q : ~q;
-        }
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        printf("testing %3u", j);
-        fflush(stdout);
-        if (compare_regions(bufa, bufb, count)) {
+        fill_pattern(bufa, count, q, ~q);
+        fill_pattern(bufb, count, q, ~q);
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 int test_blockseq_comparison(ulv *bufa, ulv *bufb, size_t count) {
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
     unsigned int j;
-    size_t i;
+    ul q;
 
-    printf("           ");
-    fflush(stdout);
+    plan(256 * 3, count);
     for (j = 0; j < 256; j++) {
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        p1 = (ulv *) bufa;
-        p2 = (ulv *) bufb;
-        printf("setting %3u", j);
-        fflush(stdout);
-        for (i = 0; i < count; i++) {
-            *p1++ = *p2++ = (ul) UL_BYTE(j);
-        }
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        printf("testing %3u", j);
-        fflush(stdout);
-        if (compare_regions(bufa, bufb, count)) {
+        q = (ul) UL_BYTE(j);
+        fill_pattern(bufa, count, q, q);
+        fill_pattern(bufb, count, q, q);
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 int test_walkbits0_comparison(ulv *bufa, ulv *bufb, size_t count) {
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
     unsigned int j;
-    size_t i;
+    ul q;
 
-    printf("           ");
-    fflush(stdout);
+    plan(UL_LEN * 2 * 3, count);
     for (j = 0; j < UL_LEN * 2; j++) {
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        p1 = (ulv *) bufa;
-        p2 = (ulv *) bufb;
-        printf("setting %3u", j);
-        fflush(stdout);
-        for (i = 0; i < count; i++) {
-            if (j < UL_LEN) { /* Walk it up. */
-                *p1++ = *p2++ = ONE << j;
-            } else { /* Walk it back down. */
-                *p1++ = *p2++ = ONE << (UL_LEN * 2 - j - 1);
-            }
+        if (j < UL_LEN) { /* Walk it up. */
+            q = ONE << j;
+        } else { /* Walk it back down. */
+            q = ONE << (UL_LEN * 2 - j - 1);
         }
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        printf("testing %3u", j);
-        fflush(stdout);
-        if (compare_regions(bufa, bufb, count)) {
+        fill_pattern(bufa, count, q, q);
+        fill_pattern(bufb, count, q, q);
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 int test_walkbits1_comparison(ulv *bufa, ulv *bufb, size_t count) {
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
     unsigned int j;
-    size_t i;
+    ul q;
 
-    printf("           ");
-    fflush(stdout);
+    plan(UL_LEN * 2 * 3, count);
     for (j = 0; j < UL_LEN * 2; j++) {
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        p1 = (ulv *) bufa;
-        p2 = (ulv *) bufb;
-        printf("setting %3u", j);
-        fflush(stdout);
-        for (i = 0; i < count; i++) {
-            if (j < UL_LEN) { /* Walk it up. */
-                *p1++ = *p2++ = UL_ONEBITS ^ (ONE << j);
-            } else { /* Walk it back down. */
-                *p1++ = *p2++ = UL_ONEBITS ^ (ONE << (UL_LEN * 2 - j - 1));
-            }
+        if (j < UL_LEN) { /* Walk it up. */
+            q = UL_ONEBITS ^ (ONE << j);
+        } else { /* Walk it back down. */
+            q = UL_ONEBITS ^ (ONE << (UL_LEN * 2 - j - 1));
         }
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        printf("testing %3u", j);
-        fflush(stdout);
-        if (compare_regions(bufa, bufb, count)) {
+        fill_pattern(bufa, count, q, q);
+        fill_pattern(bufb, count, q, q);
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 int test_bitspread_comparison(ulv *bufa, ulv *bufb, size_t count) {
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
     unsigned int j;
-    size_t i;
+    ul q;
 
-    printf("           ");
-    fflush(stdout);
+    plan(UL_LEN * 2 * 3, count);
     for (j = 0; j < UL_LEN * 2; j++) {
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        p1 = (ulv *) bufa;
-        p2 = (ulv *) bufb;
-        printf("setting %3u", j);
-        fflush(stdout);
-        for (i = 0; i < count; i++) {
-            if (j < UL_LEN) { /* Walk it up. */
-                *p1++ = *p2++ = (i % 2 == 0)
-                    ? (ONE << j) | (ONE << (j + 2))
-                    : UL_ONEBITS ^ ((ONE << j)
-                                    | (ONE << (j + 2)));
-            } else { /* Walk it back down. */
-                *p1++ = *p2++ = (i % 2 == 0)
-                    ? (ONE << (UL_LEN * 2 - 1 - j)) | (ONE << (UL_LEN * 2 + 1 - j))
-                    : UL_ONEBITS ^ (ONE << (UL_LEN * 2 - 1 - j)
-                                    | (ONE << (UL_LEN * 2 + 1 - j)));
-            }
+        if (j < UL_LEN) { /* Walk it up. */
+            q = (ONE << j) | (ONE << (j + 2));
+        } else { /* Walk it back down. */
+            q = (ONE << (UL_LEN * 2 - 1 - j)) | (ONE << (UL_LEN * 2 + 1 - j));
         }
-        printf("\b\b\b\b\b\b\b\b\b\b\b");
-        printf("testing %3u", j);
-        fflush(stdout);
-        if (compare_regions(bufa, bufb, count)) {
+        fill_pattern(bufa, count, q, UL_ONEBITS ^ q);
+        fill_pattern(bufb, count, q, UL_ONEBITS ^ q);
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 int test_bitflip_comparison(ulv *bufa, ulv *bufb, size_t count) {
-    ulv *p1 = bufa;
-    ulv *p2 = bufb;
     unsigned int j, k;
     ul q;
-    size_t i;
 
-    printf("           ");
-    fflush(stdout);
+    plan(UL_LEN * 8 * 3, count);
     for (k = 0; k < UL_LEN; k++) {
         q = ONE << k;
         for (j = 0; j < 8; j++) {
-            printf("\b\b\b\b\b\b\b\b\b\b\b");
             q = ~q;
-            printf("setting %3u", k * 8 + j);
-            fflush(stdout);
-            p1 = (ulv *) bufa;
-            p2 = (ulv *) bufb;
-            for (i = 0; i < count; i++) {
-                *p1++ = *p2++ = (i % 2) == 0 ? q : ~q;
-            }
-            printf("\b\b\b\b\b\b\b\b\b\b\b");
-            printf("testing %3u", k * 8 + j);
-            fflush(stdout);
-            if (compare_regions(bufa, bufb, count)) {
+            fill_pattern(bufa, count, q, ~q);
+            fill_pattern(bufb, count, q, ~q);
+            if (compare_regions(bufa, bufb, count) && !keep_going()) {
                 return -1;
             }
         }
     }
-    printf("\b\b\b\b\b\b\b\b\b\b\b           \b\b\b\b\b\b\b\b\b\b\b");
-    fflush(stdout);
     return 0;
 }
 
 #ifdef TEST_NARROW_WRITES    
 int test_8bit_wide_random(ulv* bufa, ulv* bufb, size_t count) {
+    union mword8 mword8;
+    struct prng *rng = prng_self();
     u8v *p1, *t;
     ulv *p2;
     int attempt;
-    unsigned int b, j = 0;
+    unsigned int b;
     size_t i;
+    unsigned long long t0;
 
-    putchar(' ');
-    fflush(stdout);
+    plan(2 * 2, count);
     for (attempt = 0; attempt < 2;  attempt++) {
         if (attempt & 1) {
             p1 = (u8v *) bufa;
@@ -464,36 +571,34 @@ int test_8bit_wide_random(ulv* bufa, ulv* bufb, size_t count) {
             p1 = (u8v *) bufb;
             p2 = bufa;
         }
+        t0 = now_ns();
         for (i = 0; i < count; i++) {
+            if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
             t = mword8.bytes;
-            *p2++ = mword8.val = rand_ul();
+            *p2++ = mword8.val = prng_ul(rng);
             for (b=0; b < UL_LEN/8; b++) {
                 *p1++ = *t++;
             }
-            if (!(i % PROGRESSOFTEN)) {
-                putchar('\b');
-                putchar(progress[++j % PROGRESSLEN]);
-                fflush(stdout);
-            }
         }
-        if (compare_regions(bufa, bufb, count)) {
+        phase_done(PHASE_WRITE, t0, count, 2 * count * sizeof(ul));
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b \b");
-    fflush(stdout);
     return 0;
 }
 
 int test_16bit_wide_random(ulv* bufa, ulv* bufb, size_t count) {
+    union mword16 mword16;
+    struct prng *rng = prng_self();
     u16v *p1, *t;
     ulv *p2;
     int attempt;
-    unsigned int b, j = 0;
+    unsigned int b;
     size_t i;
+    unsigned long long t0;
 
-    putchar( ' ' );
-    fflush( stdout );
+    plan(2 * 2, count);
     for (attempt = 0; attempt < 2; attempt++) {
         if (attempt & 1) {
             p1 = (u16v *) bufa;
@@ -502,24 +607,331 @@ int test_16bit_wide_random(ulv* bufa, ulv* bufb, size_t count) {
             p1 = (u16v *) bufb;
             p2 = bufa;
         }
+        t0 = now_ns();
         for (i = 0; i < count; i++) {
+            if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
             t = mword16.u16s;
-            *p2++ = mword16.val = rand_ul();
+            *p2++ = mword16.val = prng_ul(rng);
             for (b = 0; b < UL_LEN/16; b++) {
                 *p1++ = *t++;
             }
-            if (!(i % PROGRESSOFTEN)) {
-                putchar('\b');
-                putchar(progress[++j % PROGRESSLEN]);
-                fflush(stdout);
-            }
         }
-        if (compare_regions(bufa, bufb, count)) {
+        phase_done(PHASE_WRITE, t0, count, 2 * count * sizeof(ul));
+        if (compare_regions(bufa, bufb, count) && !keep_going()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+/* Single-buffer versions of the tests.  Instead of writing the same data to
+   bufa and bufb and comparing the two, these write one buffer covering the
+   whole region and check it against the regenerated expectation, so every
+   locked byte is a test target and each pass costs one write and one read. */
+
+int test_random_value_single(ulv *buf, size_t count) {
+    ulv *p;
+    struct prng *rng = prng_self();
+    struct prng replay = *rng; /* to generate the same values again */
+    size_t i;
+    ul q, v;
+    int r = 0;
+    unsigned long long t0;
+
+    plan(2, count);
+    p = buf;
+    t0 = now_ns();
+    for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
+        *p++ = prng_ul(rng);
+    }
+    phase_done(PHASE_WRITE, t0, count, count * sizeof(ul));
+    evict_for_verify(buf, NULL, count);
+    t0 = now_ns();
+    p = buf;
+    for (i = 0; i < count; i++, p++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return r;
+        q = prng_ul(&replay);
+        v = *p;
+        if (v != q) {
+            report_mismatch(p, v, q);
+            r = -1;
+        }
+    }
+    phase_done(PHASE_VERIFY, t0, count, count * sizeof(ul));
+    return r;
+}
+
+int test_seqinc_single(ulv *buf, size_t count) {
+    ulv *p = buf;
+    size_t i;
+    ul q = prng_ul(prng_self()), v;
+    int r = 0;
+    unsigned long long t0;
+
+    plan(2, count);
+    t0 = now_ns();
+    for (i = 0; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
+        *p++ = (i + q);
+    }
+    phase_done(PHASE_WRITE, t0, count, count * sizeof(ul));
+    evict_for_verify(buf, NULL, count);
+    t0 = now_ns();
+    p = buf;
+    for (i = 0; i < count; i++, p++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return r;
+        v = *p;
+        if (v != (ul) (i + q)) {
+            report_mismatch(p, v, (ul) (i + q));
+            r = -1;
+        }
+    }
+    phase_done(PHASE_VERIFY, t0, count, count * sizeof(ul));
+    return r;
+}
+
+int test_solidbits_single(ulv *buf, size_t count) {
+    unsigned int j;
+    ul q;
+
+    plan(64 * 2, count);
+    for (j = 0; j < 64; j++) {
+        q = (j % 2) == 0 ? UL_ONEBITS : 0;
+        fill_pattern(buf, count, q, ~q);
+        if (compare_pattern(buf, count, q, ~q) && !keep_going()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int test_checkerboard_single(ulv *buf, size_t count) {
+    unsigned int j;
+    ul q;
+
+    plan(64 * 2, count);
+    for (j = 0; j < 64; j++) {
+        q = (j % 2) == 0 ? CHECKERBOARD1 : CHECKERBOARD2;
+        fill_pattern(buf, count, q, ~q);
+        if (compare_pattern(buf, count, q, ~q) && !keep_going()) {
             return -1;
         }
     }
-    printf("\b \b");
-    fflush(stdout);
     return 0;
 }
+
+int test_blockseq_single(ulv *buf, size_t count) {
+    unsigned int j;
+    ul q;
+
+    plan(256 * 2, count);
+    for (j = 0; j < 256; j++) {
+        q = (ul) UL_BYTE(j);
+        fill_pattern(buf, count, q, q);
+        if (compare_pattern(buf, count, q, q) && !keep_going()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int test_walkbits0_single(ulv *buf, size_t count) {
+    unsigned int j;
+    ul q;
+
+    plan(UL_LEN * 2 * 2, count);
+    for (j = 0; j < UL_LEN * 2; j++) {
+        if (j < UL_LEN) { /* Walk it up. */
+            q = ONE << j;
+        } else { /* Walk it back down. */
+            q = ONE << (UL_LEN * 2 - j - 1);
+        }
+        fill_pattern(buf, count, q, q);
+        if (compare_pattern(buf, count, q, q) && !keep_going()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int test_walkbits1_single(ulv *buf, size_t count) {
+    unsigned int j;
+    ul q;
+
+    plan(UL_LEN * 2 * 2, count);
+    for (j = 0; j < UL_LEN * 2; j++) {
+        if (j < UL_LEN) { /* Walk it up. */
+            q = UL_ONEBITS ^ (ONE << j);
+        } else { /* Walk it back down. */
+            q = UL_ONEBITS ^ (ONE << (UL_LEN * 2 - j - 1));
+        }
+        fill_pattern(buf, count, q, q);
+        if (compare_pattern(buf, count, q, q) && !keep_going()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int test_bitspread_single(ulv *buf, size_t count) {
+    unsigned int j;
+    ul q;
+
+    plan(UL_LEN * 2 * 2, count);
+    for (j = 0; j < UL_LEN * 2; j++) {
+        if (j < UL_LEN) { /* Walk it up. */
+            q = (ONE << j) | (ONE << (j + 2));
+        } else { /* Walk it back down. */
+            q = (ONE << (UL_LEN * 2 - 1 - j)) | (ONE << (UL_LEN * 2 + 1 - j));
+        }
+        fill_pattern(buf, count, q, UL_ONEBITS ^ q);
+        if (compare_pattern(buf, count, q, UL_ONEBITS ^ q) && !keep_going()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int test_bitflip_single(ulv *buf, size_t count) {
+    unsigned int j, k;
+    ul q;
+
+    plan(UL_LEN * 8 * 2, count);
+    for (k = 0; k < UL_LEN; k++) {
+        q = ONE << k;
+        for (j = 0; j < 8; j++) {
+            q = ~q;
+            fill_pattern(buf, count, q, ~q);
+            if (compare_pattern(buf, count, q, ~q) && !keep_going()) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The quick screen of -q: before the full suite, go over the whole region
+   a few times with patterns that catch most bad memory, and give up at the
+   first failure so a bad unit is rejected within seconds.  Each is a moving
+   inversion: write the pattern going up, then going up again verify it and
+   write its complement, then going down verify that.  Every word has its
+   own value, computed from its address, so no second copy is needed and
+   each of the three passes moves the region once (the middle one twice). */
+
+/* The word for p: its own address, or with scramble a random-looking value
+   derived from the address and key. */
+static inline ul screen_word(ulv *p, ul key, int scramble) {
+    uint64_t z;
+
+    if (!scramble) return (ul) p;
+    z = ((uint64_t) (size_t) p ^ key) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (ul) (z ^ (z >> 31));
+}
+
+/* Whether to give up: this worker or another one has seen a failure. */
+static int screen_failed(int r) {
+    struct session *s = session_self();
+
+    return r || (s && s->fails && fail_words(s->fails));
+}
+
+static int moving_inversion(ulv *buf, size_t count, ul key, int scramble) {
+    ulv *p;
+    size_t i;
+    ul q, v;
+    int r = 0;
+    unsigned long long t0;
+
+    plan(3, count);
+    t0 = now_ns();
+    for (i = 0, p = buf; i < count; i++, p++) {
+        if (!(i % CHUNK_WORDS) && stopping(i)) return 0;
+        *p = screen_word(p, key, scramble);
+    }
+    phase_done(PHASE_WRITE, t0, count, count * sizeof(ul));
+    evict_for_verify(buf, NULL, count);
+    t0 = now_ns();
+    for (i = 0, p = buf; i < count; i++, p++) {
+        if (!(i % CHUNK_WORDS) && (screen_failed(r) || stopping(i))) return r;
+        q = screen_word(p, key, scramble);
+        v = *p;
+        if (v != q) {
+            report_mismatch(p, v, q);
+            r = -1;
+        }
+        *p = ~q;
+    }
+    phase_done(PHASE_VERIFY, t0, count, 2 * count * sizeof(ul));
+    evict_for_verify(buf, NULL, count);
+    t0 = now_ns();
+    for (i = 0, p = buf + count; i < count; i++) {
+        if (!(i % CHUNK_WORDS) && (screen_failed(r) || stopping(i))) return r;
+        p--;
+        q = ~screen_word(p, key, scramble);
+        v = *p;
+        if (v != q) {
+            report_mismatch(p, v, q);
+            r = -1;
+        }
+    }
+    phase_done(PHASE_VERIFY, t0, count, count * sizeof(ul));
+    return r;
+}
+
+int test_moving_inversion(ulv *buf, size_t count) {
+    return moving_inversion(buf, count, prng_ul(prng_self()), 1);
+}
+
+int test_own_address(ulv *buf, size_t count) {
+    return moving_inversion(buf, count, 0, 0);
+}
+
+/* The tests in the order a loop runs them; see also README.tests. */
+struct test tests[] = {
+    { "Random Value", test_random_value, 1 },
+    { "Compare XOR", test_xor_comparison, 1 },
+    { "Compare SUB", test_sub_comparison, 1 },
+    { "Compare MUL", test_mul_comparison, 1 },
+    { "Compare DIV", test_div_comparison, 1 },
+    { "Compare OR", test_or_comparison, 1 },
+    { "Compare AND", test_and_comparison, 1 },
+    { "Sequential Increment", test_seqinc_comparison, 1 },
+    { "Solid Bits", test_solidbits_comparison, 64 },
+    { "Block Sequential", test_blockseq_comparison, 256 },
+    { "Checkerboard", test_checkerboard_comparison, 64 },
+    { "Bit Spread", test_bitspread_comparison, UL_LEN * 2 },
+    { "Bit Flip", test_bitflip_comparison, UL_LEN * 8 },
+    { "Walking Ones", test_walkbits1_comparison, UL_LEN * 2 },
+    { "Walking Zeroes", test_walkbits0_comparison, UL_LEN * 2 },
+#ifdef TEST_NARROW_WRITES    
+    { "8-bit Writes", test_8bit_wide_random, 2 },
+    { "16-bit Writes", test_16bit_wide_random, 2 },
 #endif
+    { NULL, NULL, 0 }
+};
+
+/* Used with -s: one buffer covering the whole region, checked against the
+   regenerated expectation instead of a second copy. */
+struct test single_tests[] = {
+    { "Random Value", test_random_value_single, 1 },
+    { "Sequential Increment", test_seqinc_single, 1 },
+    { "Solid Bits", test_solidbits_single, 64 },
+    { "Block Sequential", test_blockseq_single, 256 },
+    { "Checkerboard", test_checkerboard_single, 64 },
+    { "Bit Spread", test_bitspread_single, UL_LEN * 2 },
+    { "Bit Flip", test_bitflip_single, UL_LEN * 8 },
+    { "Walking Ones", test_walkbits1_single, UL_LEN * 2 },
+    { "Walking Zeroes", test_walkbits0_single, UL_LEN * 2 },
+    { NULL, NULL, 0 }
+};
+
+/* Run by -q before the first loop, on both halves of the region. */
+struct test screen_tests[] = {
+    { "Moving Inversion", test_moving_inversion, 2 },
+    { "Own Address", test_own_address, 2 },
+    { NULL, NULL, 0 }
+};
@@ -14,8 +14,17 @@
  *
  */
 
+/* The test tables, ending in a NULL entry; see tests.c.  Include types.h
+   first. */
+
+extern struct test tests[];
+extern struct test single_tests[];
+extern struct test screen_tests[];
+
 /* Function declaration. */
 
+int compare_regions(unsigned long volatile *bufa, unsigned long volatile *bufb, size_t count);
+
 int test_stuck_address(unsigned long volatile *bufa, size_t count);
 int test_random_value(unsigned long volatile *bufa, unsigned long volatile *bufb, size_t count);
 int test_xor_comparison(unsigned long volatile *bufa, unsigned long volatile *bufb, size_t count);
@@ -36,4 +45,15 @@ int test_bitflip_comparison(unsigned long volatile *bufa, unsigned long volatile
 int test_8bit_wide_random(unsigned long volatile *bufa, unsigned long volatile *bufb, size_t count);
 int test_16bit_wide_random(unsigned long volatile *bufa, unsigned long volatile *bufb, size_t count);
 #endif
+int test_random_value_single(unsigned long volatile *buf, size_t count);
+int test_seqinc_single(unsigned long volatile *buf, size_t count);
+int test_solidbits_single(unsigned long volatile *buf, size_t count);
+int test_checkerboard_single(unsigned long volatile *buf, size_t count);
+int test_blockseq_single(unsigned long volatile *buf, size_t count);
+int test_walkbits0_single(unsigned long volatile *buf, size_t count);
+int test_walkbits1_single(unsigned long volatile *buf, size_t count);
+int test_bitspread_single(unsigned long volatile *buf, size_t count);
+int test_bitflip_single(unsigned long volatile *buf, size_t count);
+int test_moving_inversion(unsigned long volatile *buf, size_t count);
+int test_own_address(unsigned long volatile *buf, size_t count);
 
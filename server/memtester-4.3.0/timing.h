@@ -0,0 +1,28 @@
+/*
+ * Very simple but very effective user-space memory tester.
+ * Originally by Simon Kirby <sim@stormix.com> <sim@neato.org>
+ * Version 2 by Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Version 3 not publicly released.
+ * Version 4 rewrite:
+ * Copyright (C) 2004-2012 Charles Cazabon <charlesc-memtester@pyropus.ca>
+ * Licensed under the terms of the GNU General Public License version 2 (only).
+ * See the file COPYING for details.
+ *
+ * This file contains the clock used to time tests and their phases.
+ *
+ */
+
+#ifndef MEMTESTER_TIMING_H
+#define MEMTESTER_TIMING_H
+
+#include <time.h>
+
+/* Monotonic time in nanoseconds. */
+static inline unsigned long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif /* MEMTESTER_TIMING_H */
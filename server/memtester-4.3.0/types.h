@@ -23,14 +23,17 @@ typedef unsigned short volatile u16v;
 struct test {
     char *name;
     int (*fp)();
+    unsigned int patterns;              /* written and verified per run */
 };
 
-union {
+/* Scratch words for the narrow-write tests; each caller keeps its own so
+   the tests can run on several threads at once. */
+union mword8 {
     unsigned char bytes[UL_LEN/8];
     ul val;
-} mword8;
+};
 
-union {
+union mword16 {
     unsigned short u16s[UL_LEN/16];
     ul val;
-} mword16;
+};